@@ -0,0 +1,31 @@
+#!/bin/bash
+# Connection churn: every request uses a fresh connection (connect, one
+# request, close), so per-connection setup and teardown dominate.
+#
+# Usage: bench/churn_bench.sh [duration_seconds] [concurrency] [runs]
+
+DURATION=${1:-5}
+ACTIVE=${2:-4}
+RUNS=${3:-3}
+CONF=conf/basic_config.conf
+PORT=8080
+
+cd "$(dirname "$0")/.." || exit 1
+make -s all bench || exit 1
+
+for run in $(seq 1 "$RUNS"); do
+	./webserv "$CONF" > /tmp/webserv_bench.log 2>&1 &
+	pid=$!
+	sleep 0.5
+	result=$(bench/loadgen -p "$PORT" -a "$ACTIVE" -d "$DURATION" -c 2>/dev/null)
+	# Server CPU (user + system, in clock ticks) spent per connection
+	ticks=$(awk '{print $14 + $15}' "/proc/$pid/stat" 2>/dev/null)
+	requests=$(echo "$result" | sed -n 's/.*requests=\([0-9]*\).*/\1/p')
+	kill -INT "$pid"
+	wait "$pid" 2>/dev/null
+	per_conn="n/a"
+	if [ -n "$ticks" ] && [ "${requests:-0}" -gt 0 ]; then
+		per_conn="$((ticks * 1000000 / $(getconf CLK_TCK) / requests)) us"
+	fi
+	printf "run %d  %s | server CPU per connection: %s\n" "$run" "${result:-failed}" "$per_conn"
+done
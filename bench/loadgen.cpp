@@ -0,0 +1,328 @@
+// Minimal HTTP/1.1 load generator used by the benchmarks in this directory.
+// Opens a number of idle connections that are only held open, plus a small
+// set of active keep-alive connections issuing requests back to back, and
+// reports throughput and latency percentiles of the active set.
+// With -c every active request uses a fresh connection (connect, one
+// request, close) to measure connection churn; latency then includes connect.
+// Those connections are aborted with a reset once answered so neither side
+// piles up TIME_WAIT sockets, which would otherwise skew repeated runs.
+// With -U the connections go to a Unix domain socket instead of TCP.
+// With -P each active connection sends that many pipelined requests at once
+// and waits for all of their responses; latency runs from the batch's send.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+struct Options
+{
+	std::string host;
+	int port;
+	std::string path;
+	std::string unixPath;
+	int idle;
+	int active;
+	int duration;
+	int pipeline;
+	bool closeEach;
+
+	Options() : host("127.0.0.1"), port(8080), path("/"), idle(0), active(1), duration(5), pipeline(1), closeEach(false) {}
+};
+
+struct ActiveConnection
+{
+	int fd;
+	std::string response;
+	unsigned long sentAt;
+	bool waiting;
+	int outstanding; // Responses of the pipelined batch still expected
+};
+
+static unsigned long nowMicros()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000UL + tv.tv_usec;
+}
+
+static void usage(const char *name)
+{
+	std::cerr << "Usage: " << name << " [-H host] [-p port] [-u path] [-U socket] [-i idle] [-a active] [-d seconds] [-P depth] [-c]" << std::endl;
+	std::exit(2);
+}
+
+static void raiseFdLimit()
+{
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0)
+	{
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+}
+
+// Connects to the server's Unix socket (-U)
+static int openUnixConnection(const Options &opt)
+{
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, opt.unixPath.c_str(), sizeof(addr.sun_path) - 1);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Connects to the server. On loopback the source address is rotated
+// across 127.0.0.x so tens of thousands of connections do not exhaust
+// the ephemeral port range of a single source address.
+static int openConnection(const Options &opt, int index)
+{
+	if (!opt.unixPath.empty())
+		return openUnixConnection(opt);
+
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	if (opt.host.compare(0, 4, "127.") == 0)
+	{
+		struct sockaddr_in local;
+		memset(&local, 0, sizeof(local));
+		local.sin_family = AF_INET;
+		local.sin_addr.s_addr = htonl(0x7f000001 + 1 + index / 20000);
+		bind(fd, (struct sockaddr *)&local, sizeof(local));
+	}
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(opt.port);
+	inet_pton(AF_INET, opt.host.c_str(), &addr.sin_addr);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return fd;
+}
+
+// Length of the first full response (headers + Content-Length body) in
+// response, 0 while it is incomplete
+static size_t completeResponseLength(const std::string &response)
+{
+	size_t headerEnd = response.find("\r\n\r\n");
+	if (headerEnd == std::string::npos)
+		return 0;
+
+	size_t contentLength = 0;
+	size_t pos = response.find("Content-Length:");
+	if (pos != std::string::npos && pos < headerEnd)
+		contentLength = std::strtoul(response.c_str() + pos + 15, NULL, 10);
+	if (response.size() < headerEnd + 4 + contentLength)
+		return 0;
+	return headerEnd + 4 + contentLength;
+}
+
+static void abortConnection(int fd)
+{
+	struct linger lingerOpt;
+	lingerOpt.l_onoff = 1;
+	lingerOpt.l_linger = 0;
+	setsockopt(fd, SOL_SOCKET, SO_LINGER, &lingerOpt, sizeof(lingerOpt));
+	close(fd);
+}
+
+static unsigned long percentile(const std::vector<unsigned long> &sorted, double p)
+{
+	if (sorted.empty())
+		return 0;
+	size_t index = static_cast<size_t>(p * (sorted.size() - 1));
+	return sorted[index];
+}
+
+int main(int argc, char *argv[])
+{
+	Options opt;
+	int c;
+	while ((c = getopt(argc, argv, "H:p:u:U:i:a:d:P:c")) != -1)
+	{
+		switch (c)
+		{
+		case 'H': opt.host = optarg; break;
+		case 'p': opt.port = std::atoi(optarg); break;
+		case 'u': opt.path = optarg; break;
+		case 'U': opt.unixPath = optarg; break;
+		case 'i': opt.idle = std::atoi(optarg); break;
+		case 'a': opt.active = std::atoi(optarg); break;
+		case 'd': opt.duration = std::atoi(optarg); break;
+		case 'P': opt.pipeline = std::atoi(optarg); break;
+		case 'c': opt.closeEach = true; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (opt.active <= 0 || opt.duration <= 0 || opt.pipeline <= 0)
+		usage(argv[0]);
+
+	raiseFdLimit();
+
+	std::ostringstream request;
+	request << "GET " << opt.path << " HTTP/1.1\r\n"
+			<< "Host: " << opt.host << ":" << opt.port << "\r\n"
+			<< "Connection: keep-alive\r\n\r\n";
+	std::string requestStr;
+	for (int i = 0; i < opt.pipeline; ++i)
+		requestStr += request.str();
+
+	std::vector<int> idleFds;
+	for (int i = 0; i < opt.idle; ++i)
+	{
+		int fd = openConnection(opt, i);
+		if (fd < 0)
+		{
+			std::cerr << "idle connection " << i << " failed: " << strerror(errno) << std::endl;
+			break;
+		}
+		idleFds.push_back(fd);
+	}
+
+	std::vector<ActiveConnection> conns;
+	for (int i = 0; i < opt.active; ++i)
+	{
+		ActiveConnection conn;
+		conn.fd = openConnection(opt, opt.idle + i);
+		conn.waiting = false;
+		conn.outstanding = 0;
+		conn.sentAt = nowMicros();
+		if (conn.fd < 0)
+		{
+			std::cerr << "active connection " << i << " failed: " << strerror(errno) << std::endl;
+			return 1;
+		}
+		conns.push_back(conn);
+	}
+
+	// Source addresses rotate with every new connection in churn mode
+	int nextIndex = opt.idle + opt.active;
+
+	std::vector<unsigned long> latencies;
+	unsigned long errors = 0;
+	unsigned long start = nowMicros();
+	unsigned long end = start + opt.duration * 1000000UL;
+	std::vector<struct pollfd> pfds(conns.size());
+	char buffer[65536];
+
+	while (nowMicros() < end)
+	{
+		for (size_t i = 0; i < conns.size(); ++i)
+		{
+			if (conns[i].fd < 0 && opt.closeEach)
+			{
+				conns[i].sentAt = nowMicros();
+				conns[i].fd = openConnection(opt, nextIndex++);
+			}
+			if (!conns[i].waiting && conns[i].fd >= 0)
+			{
+				conns[i].response.clear();
+				if (!opt.closeEach)
+					conns[i].sentAt = nowMicros();
+				if (send(conns[i].fd, requestStr.c_str(), requestStr.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(requestStr.size()))
+				{
+					errors++;
+					close(conns[i].fd);
+					conns[i].fd = openConnection(opt, opt.idle + i);
+					continue;
+				}
+				conns[i].waiting = true;
+				conns[i].outstanding = opt.pipeline;
+			}
+			pfds[i].fd = conns[i].fd;
+			pfds[i].events = POLLIN;
+			pfds[i].revents = 0;
+		}
+
+		if (poll(&pfds[0], pfds.size(), 100) <= 0)
+			continue;
+
+		for (size_t i = 0; i < conns.size(); ++i)
+		{
+			if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+			ssize_t n = recv(conns[i].fd, buffer, sizeof(buffer), 0);
+			if (n <= 0)
+			{
+				// Server closed the connection, reconnect and retry
+				errors++;
+				close(conns[i].fd);
+				conns[i].fd = openConnection(opt, opt.idle + i);
+				conns[i].waiting = false;
+				continue;
+			}
+			conns[i].response.append(buffer, n);
+			size_t length;
+			while (conns[i].outstanding > 0 && (length = completeResponseLength(conns[i].response)) > 0)
+			{
+				latencies.push_back(nowMicros() - conns[i].sentAt);
+				conns[i].response.erase(0, length);
+				conns[i].outstanding--;
+			}
+			if (conns[i].outstanding == 0)
+			{
+				conns[i].waiting = false;
+				if (opt.closeEach)
+				{
+					abortConnection(conns[i].fd);
+					conns[i].sentAt = nowMicros();
+					conns[i].fd = openConnection(opt, nextIndex++);
+					if (conns[i].fd < 0)
+						errors++;
+				}
+			}
+		}
+	}
+
+	double elapsed = (nowMicros() - start) / 1000000.0;
+	std::sort(latencies.begin(), latencies.end());
+
+	std::cout << "idle=" << idleFds.size()
+			  << " active=" << conns.size()
+			  << " pipeline=" << opt.pipeline
+			  << " requests=" << latencies.size()
+			  << " errors=" << errors
+			  << " rps=" << static_cast<unsigned long>(latencies.size() / elapsed)
+			  << " p50_us=" << percentile(latencies, 0.50)
+			  << " p99_us=" << percentile(latencies, 0.99)
+			  << std::endl;
+
+	for (size_t i = 0; i < idleFds.size(); ++i)
+		close(idleFds[i]);
+	for (size_t i = 0; i < conns.size(); ++i)
+		if (conns[i].fd >= 0)
+			close(conns[i].fd);
+	return 0;
+}
@@ -0,0 +1,32 @@
+#!/bin/bash
+# Pipelined keep-alive requests: each connection sends a batch of requests
+# at once and waits for all the responses, for several pipeline depths.
+#
+# Usage: bench/pipeline_bench.sh [duration_seconds] [active_connections]
+#        DEPTHS="1 8" bench/pipeline_bench.sh   (override the depth sweep)
+
+DURATION=${1:-5}
+ACTIVE=${2:-4}
+CONF=conf/basic_config.conf
+PORT=8080
+DEPTHS=${DEPTHS:-"1 16 64"}
+
+cd "$(dirname "$0")/.." || exit 1
+make -s all bench || exit 1
+
+for depth in $DEPTHS; do
+	./webserv "$CONF" > /tmp/webserv_bench.log 2>&1 &
+	pid=$!
+	sleep 0.5
+	result=$(bench/loadgen -p "$PORT" -a "$ACTIVE" -d "$DURATION" -P "$depth" 2>/dev/null)
+	# Server CPU (user + system, in clock ticks) spent per request
+	ticks=$(awk '{print $14 + $15}' "/proc/$pid/stat" 2>/dev/null)
+	requests=$(echo "$result" | sed -n 's/.*requests=\([0-9]*\).*/\1/p')
+	kill -INT "$pid"
+	wait "$pid" 2>/dev/null
+	per_request="n/a"
+	if [ -n "$ticks" ] && [ "${requests:-0}" -gt 0 ]; then
+		per_request="$((ticks * 1000000 / $(getconf CLK_TCK) / requests)) us"
+	fi
+	printf "depth %-3s %s | server CPU per request: %s\n" "$depth" "${result:-failed}" "$per_request"
+done
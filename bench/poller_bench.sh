@@ -0,0 +1,37 @@
+#!/bin/bash
+# Compares the select, poll and epoll backends with a growing number of idle
+# connections plus a small active keep-alive set.
+#
+# Usage: bench/poller_bench.sh [duration_seconds] [active_connections]
+#        IDLE_COUNTS="100 1000" bench/poller_bench.sh   (override the idle sweep)
+#
+# Needs a high fd limit (ulimit -n) for the larger runs; select cannot go
+# past FD_SETSIZE and is skipped there.
+
+DURATION=${1:-5}
+ACTIVE=${2:-8}
+CONF=conf/basic_config.conf
+PORT=8080
+IDLE_COUNTS=${IDLE_COUNTS:-"100 1000 10000 50000"}
+
+cd "$(dirname "$0")/.." || exit 1
+make -s all bench || exit 1
+ulimit -n 120000 2>/dev/null || ulimit -n "$(ulimit -Hn)"
+
+printf "%-7s %7s  %s\n" backend idle "result"
+for backend in select poll epoll; do
+	for idle in $IDLE_COUNTS; do
+		if [ "$backend" = select ] && [ "$idle" -gt 1000 ]; then
+			printf "%-7s %7s  %s\n" "$backend" "$idle" "skipped (FD_SETSIZE)"
+			continue
+		fi
+		./webserv -b "$backend" "$CONF" > /tmp/webserv_bench.log 2>&1 &
+		pid=$!
+		sleep 0.5
+		result=$(bench/loadgen -p "$PORT" -i "$idle" -a "$ACTIVE" -d "$DURATION" 2>/dev/null)
+		kill -INT "$pid"
+		wait "$pid" 2>/dev/null
+		loop=$(grep -a "Event loop" /tmp/webserv_bench.log | sed 's/^Event loop ([a-z]*): //')
+		printf "%-7s %7s  %s | %s\n" "$backend" "$idle" "${result:-failed}" "$loop"
+	done
+done
@@ -0,0 +1,46 @@
+#!/bin/bash
+# Same-host proxy path: one server block on loopback TCP and one on a Unix
+# domain socket, both serving the same small file, measured in turn.
+#
+# Usage: bench/unix_socket_bench.sh [duration_seconds] [active_connections] [runs]
+
+DURATION=${1:-5}
+ACTIVE=${2:-8}
+RUNS=${3:-3}
+PORT=8080
+WORK=$(mktemp -d /tmp/webserv_unix.XXXXXX)
+SOCKET=$WORK/webserv.sock
+
+cd "$(dirname "$0")/.." || exit 1
+make -s all bench || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+mkdir -p "$WORK/www"
+head -c 1024 /dev/zero | tr '\0' 'x' > "$WORK/www/index.html"
+cat > "$WORK/unix.conf" <<CONF
+server {
+    listen $PORT;
+    location / {
+        root $WORK/www;
+        allow_methods GET;
+    }
+}
+server {
+    listen unix:$SOCKET;
+    location / {
+        root $WORK/www;
+        allow_methods GET;
+    }
+}
+CONF
+
+./webserv "$WORK/unix.conf" > /tmp/webserv_bench.log 2>&1 &
+pid=$!
+sleep 0.5
+for run in $(seq 1 "$RUNS"); do
+	tcp=$(bench/loadgen -p "$PORT" -a "$ACTIVE" -d "$DURATION" 2>/dev/null)
+	unix=$(bench/loadgen -U "$SOCKET" -a "$ACTIVE" -d "$DURATION" 2>/dev/null)
+	printf "run %d  tcp:  %s\n       unix: %s\n" "$run" "${tcp:-failed}" "${unix:-failed}"
+done
+kill -INT "$pid"
+wait "$pid" 2>/dev/null
@@ -0,0 +1,43 @@
+#!/bin/bash
+# Small-object latency under a concurrent large-file load, with the default
+# write order and with 'write_scheduling srpt'.
+#
+# Usage: bench/write_sched_bench.sh [duration_seconds] [bulk_connections] [small_connections]
+
+DURATION=${1:-5}
+BULK=${2:-8}
+SMALL=${3:-4}
+PORT=8080
+WORK=$(mktemp -d /tmp/webserv_sched.XXXXXX)
+
+cd "$(dirname "$0")/.." || exit 1
+make -s all bench || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+mkdir -p "$WORK/www"
+head -c 2048 /dev/zero | tr '\0' 'x' > "$WORK/www/small.html"
+head -c 16777216 /dev/zero > "$WORK/www/large.bin"
+
+for mode in fifo srpt; do
+	cat > "$WORK/$mode.conf" <<CONF
+write_scheduling $mode;
+server {
+    listen $PORT;
+    location / {
+        root $WORK/www;
+        allow_methods GET;
+    }
+}
+CONF
+	./webserv "$WORK/$mode.conf" > /tmp/webserv_bench.log 2>&1 &
+	pid=$!
+	sleep 0.5
+	bench/loadgen -p "$PORT" -u /large.bin -a "$BULK" -d "$DURATION" > "$WORK/bulk.out" 2>/dev/null &
+	bulk=$!
+	sleep 0.2
+	small=$(bench/loadgen -p "$PORT" -u /small.html -a "$SMALL" -d "$DURATION" 2>/dev/null)
+	wait "$bulk"
+	kill -INT "$pid"
+	wait "$pid" 2>/dev/null
+	printf "%-4s small: %s\n     bulk:  %s\n" "$mode" "${small:-failed}" "$(cat "$WORK/bulk.out")"
+done
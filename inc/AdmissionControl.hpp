@@ -0,0 +1,57 @@
+#ifndef ADMISSION_CONTROL_HPP
+#define ADMISSION_CONTROL_HPP
+
+#include <map>
+#include <stdint.h>
+#include <pthread.h>
+
+// Counts open connections globally, per listening address and per client
+// IP so accept can refuse one that would exceed a limit before anything is
+// allocated for it. One instance is shared by the acceptor and the loop
+// threads of a process; limits are passed in from the current config.
+// It also carries the process's fd headroom: the accepting side measures
+// it, the loops holding idle connections act on it.
+class AdmissionControl
+{
+public:
+	// What a connection was counted under, released when it closes
+	struct Ticket
+	{
+		int listener;	  // Listening fd, which a reload keeps for an unchanged address
+		uint32_t address; // Client IPv4 address, network byte order
+	};
+
+	// 0 disables a limit
+	struct Limits
+	{
+		int total;
+		int perServer;
+		int perIp;
+	};
+
+private:
+	int _total; // Changed under the mutex, atomically so getTotal() needs no lock
+	std::map<int, int> _perListener; // Only listeners with open connections
+	std::map<uint32_t, int> _perIp;	 // Only addresses with open connections
+	int _fdHeadroom;				// Free fds below RLIMIT_NOFILE, read lock-free
+	pthread_mutex_t _mutex;
+
+	AdmissionControl(const AdmissionControl &);
+	AdmissionControl &operator=(const AdmissionControl &);
+
+public:
+	AdmissionControl();
+	~AdmissionControl();
+
+	// Counts the connection and returns true if it is within limits
+	bool admit(const Ticket &ticket, const Limits &limits);
+	void release(const Ticket &ticket);
+
+	int getTotal() const;
+
+	void setFdHeadroom(int headroom);
+	void addFdHeadroom(int freed);
+	int getFdHeadroom() const;
+};
+
+#endif
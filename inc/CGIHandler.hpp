@@ -13,6 +13,58 @@
 
 class CGIHandler
 {
+public:
+	enum Progress
+	{
+		CGI_RUNNING,  // Waiting on a pipe or on the child to exit
+		CGI_DONE,	  // Exited with status 0, output holds the response body
+		CGI_FAILED,	  // Could not run, or exited abnormally
+		CGI_TIMED_OUT // Killed after TIMEOUT_MS
+	};
+
+	// A running script. Its pipes are non-blocking and owned by the caller's
+	// event loop, which calls resume() whenever one is ready or a timer fires.
+	// A pipe is -1 once closed, closePipe() is left to the loop so it can
+	// unregister the fd first.
+	struct Process
+	{
+		pid_t pid;
+		int inputFd;  // Request body to the script's stdin
+		int outputFd; // Script's stdout
+		std::string input;
+		size_t inputOffset;
+		std::string output;
+		bool outputClosed; // EOF seen on outputFd
+		int status;
+		unsigned long startedAt; // Monotonic milliseconds
+
+		Process();
+	};
+
+	static const unsigned long TIMEOUT_MS;
+	static const unsigned long REAP_RETRY_MS; // Between waitpid() tries once stdout closed
+
+	// Forks the script with the request body queued for its stdin
+	static bool spawn(const std::string &scriptPath,
+					  const std::string &requestBody,
+					  const std::map<std::string, std::string> &envVars,
+					  Process &process);
+
+	// Moves data through whichever pipes are ready without blocking,
+	// reaps the child once its output is complete and enforces TIMEOUT_MS
+	static Progress resume(Process &process, unsigned long nowMs);
+
+	// Pipes the loop should watch, -1 for none
+	static int getWaitingInputFd(const Process &process);
+	static int getWaitingOutputFd(const Process &process);
+
+	// Monotonic time resume() needs to run by even if no pipe becomes ready
+	static unsigned long getDeadline(const Process &process, unsigned long nowMs);
+
+	// Kills and reaps the child if still running and closes both pipes
+	static void abort(Process &process);
+	static void closePipe(int &fd);
+
 private:
 	// Private constructor to prevent instantiation
 	CGIHandler();
@@ -26,19 +78,9 @@ private:
 	static void childProcess(int *pipe_in, int *pipe_out, const std::string &scriptPath,
 							 char **envp, char **argv);
 
-	// Reads the output from the pipe
-	static std::string readFromPipe(int pipe_fd);
-
-	// Writes request data to the pipe
-	static void writeToPipe(int pipe_fd, const std::string &data);
-
-public:
-	// Main method to execute the CGI script
-	// Takes the script path, request data (for POST),
-	// and the required environment variables.
-	static std::string executeCGI(const std::string &scriptPath,
-								  const std::string &requestBody,
-								  const std::map<std::string, std::string> &envVars);
+	// Non-blocking halves of the exchange, false on a pipe error
+	static bool readFromPipe(Process &process);
+	static bool writeToPipe(Process &process);
 };
 
 #endif
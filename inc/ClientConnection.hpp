@@ -2,6 +2,14 @@
 #define CLIENT_CONNECTION_HPP
 
 #include <string>
+#include <deque>
+#include <ctime>
+#include <TimerWheel.hpp>
+#include <AdmissionControl.hpp>
+#include <IdleList.hpp>
+
+struct PendingResponse; // Owned by the Server, see Server::processRequest()
+class Poller;
 
 enum ConnectionState
 {
@@ -16,39 +24,75 @@ enum ConnectionState
 class ClientConnection
 {
 private:
+	// Hot: touched on every event, kept together at the front
 	int _fd;
 	ConnectionState _state;
-	time_t _lastActivity;
-	time_t _createdAt;
-
-	// Buffers
-	std::string _readBuffer;
-	std::string _writeBuffer;
-	size_t _writeOffset;
-
-	// HTTP Parsing State
-	size_t _contentLength;
+	unsigned int _pollEvents; // Events currently registered with the poller, may be none
+	bool _pollRegistered;	  // Added to the poller, modify() from then on
+	bool _markedForRemoval;
+	bool _keepAlive;
 	bool _hasContentLength;
+	bool _deferred; // Complete requests left over from a spent work budget
+	bool _readPaused; // Queued output above the high water mark, see Server::processBufferedRequests()
+	bool _writeQueued; // In Server::_writeQueue until this iteration's flush
 	// bool _isChunked;
+	size_t _writeOffset;	   // Into the front of _responseQueue
+	size_t _pendingWriteBytes; // Left to send across _responseQueue
+	size_t _contentLength;
+	size_t _readSize; // Bytes asked of the next recv(), see readData()
+	TimerWheel::Node _timerNode; // Deadline, owned by the Server's TimerWheel
+	IdleList::Node _idleNode;	 // Linked while in CONN_KEEP_ALIVE, see Server::touchClient()
+	PendingResponse *_pendingResponse; // Suspended handler while in CONN_PROCESSING_REQUEST
+	Poller *_receiver; // Receives for this connection, NULL to call recv(), see readData()
+
+	// Request phase timing in monotonic milliseconds
+	unsigned long _requestStartedAt;
+	unsigned long _bodyStartedAt; // 0 while the request head is incomplete
+	unsigned long _lastWriteAt;
+	size_t _headerLength;
+
+	// The read buffer's capacity survives reuse through the ConnectionPool.
+	// Responses are queued in request order, moved in rather than copied.
+	std::string _readBuffer;
+	std::deque<std::string> _responseQueue;
 
-	// Connection Properties
-	bool _keepAlive;
+	// Cold: client info and statistics
 	std::string _clientIP;
 	int _clientPort;
-
-	// Statistics
+	std::string _unixListener; // Host of the Unix socket listener accepted on, empty over TCP
+	AdmissionControl::Ticket _admissionTicket;
+	time_t _lastActivity;
+	time_t _createdAt;
 	size_t _bytesRead;
 	size_t _bytesWritten;
 	int _requestCount;
 
+	// recv() size bounds: idle keep-alive connections start small, a
+	// connection filling every read doubles it up to the maximum
+	static const size_t _MIN_READ_SIZE;
+	static const size_t _MAX_READ_SIZE;
+	static const size_t _MAX_WRITE_IOVECS; // Queued responses sent per sendmsg()
+
+	void updateRequestPhase(unsigned long now);
+
+	ClientConnection(const ClientConnection &);
+	ClientConnection &operator=(const ClientConnection &);
+
 public:
+	ClientConnection();
 	ClientConnection(int fd);
 	~ClientConnection();
 
+	// Pooling: reset() readies an unused object for fd, close() retires it
+	void reset(int fd);
+	void close();
+	void shrinkBuffers(size_t maxCapacity);
+
 	// I/O Operations
-	bool readData();
-	bool writeData();
-	void appendToWriteBuffer(const std::string &data);
+	bool readData(size_t maxBytes = 0); // 0 reads until the socket is drained
+	bool writeData(size_t maxBytes = 0); // 0 sends as much as the socket takes
+	void setReceiver(Poller *receiver);
+	void queueResponse(std::string &data); // Takes the content, data is left empty
 	void clearReadBuffer();
 	void clearWriteBuffer();
 
@@ -59,8 +103,8 @@ public:
 
 	// Buffer Access
 	const std::string &getReadBuffer() const;
-	const std::string &getWriteBuffer() const;
 	bool hasDataToWrite() const;
+	size_t getPendingWriteBytes() const;
 	bool hasCompleteRequest() const;
 
 	// Timeout Checking
@@ -77,6 +121,10 @@ public:
 	void setClientInfo(const std::string &ip, int port);
 	const std::string &getClientIP() const;
 	int getClientPort() const;
+	void setUnixListener(const std::string &host);
+	const std::string &getUnixListener() const;
+	void setAdmissionTicket(const AdmissionControl::Ticket &ticket);
+	const AdmissionControl::Ticket &getAdmissionTicket() const;
 
 	// Statistics
 	size_t getBytesRead() const;
@@ -93,6 +141,36 @@ public:
 	bool needsWrite() const;
 	bool shouldClose() const;
 	bool hasContentLength() const;
+
+	// Poller Interest
+	unsigned int getPollEvents() const;
+	void setPollEvents(unsigned int events);
+	bool isPollRegistered() const;
+	void setPollRegistered(bool registered);
+
+	// Request Phases
+	void startNextRequest(); // The previous request was consumed from the read buffer
+	bool isReadingBody() const;
+	unsigned long getRequestStartedAt() const;
+	unsigned long getBodyStartedAt() const;
+	unsigned long getLastWriteAt() const;
+	size_t getBodyBytesRead() const;
+
+	// Timeouts and Removal
+	TimerWheel::Node &getTimerNode();
+	IdleList::Node &getIdleNode();
+	bool isMarkedForRemoval() const;
+	void setMarkedForRemoval();
+	bool isDeferred() const;
+	void setDeferred(bool deferred);
+	bool isReadPaused() const;
+	void setReadPaused(bool paused);
+	bool isWriteQueued() const;
+	void setWriteQueued(bool queued);
+
+	// Suspended Request Handling
+	PendingResponse *getPendingResponse() const;
+	void setPendingResponse(PendingResponse *pending);
 };
 
 #endif
\ No newline at end of file
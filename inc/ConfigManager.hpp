@@ -6,6 +6,8 @@
 #include <vector>
 #include <map>
 
+// After loadConfig() every lookup is const and read-only, so one instance
+// can be shared by all event-loop threads without locking.
 class ConfigManager
 {
 private:
@@ -24,6 +26,19 @@ public:
 
 	// Server access methods
 	const std::vector<ServerConfig> &getServers() const;
+	const std::string &getEventBackend() const;
+	int getWorkerProcesses() const; // Resolves 'auto' to the number of online CPUs
+	int getWorkerThreads() const;	// Resolves 'auto' to the number of online CPUs
+	const ConnectionTimeouts &getTimeouts() const;
+	int getShutdownTimeout() const;
+	int getKeepaliveRequests() const; // 0 is unlimited
+	int getMaxConnections() const;
+	int getMaxConnectionsPerIp() const;
+	int getWorkerRlimitNofile() const; // 0 for 'auto', the hard limit
+	bool useShortestFirstWrites() const;
+	size_t getOutputHighWater() const; // 0 when backpressure is off
+	size_t getOutputLowWater() const;
+	const std::vector<std::string> &getWorkerCpuAffinity() const; // Empty when off, see CpuAffinity.hpp
 	const ServerConfig *findServer(const std::string &host, int port) const;
 	const ServerConfig *findServerByName(const std::string &server_name, const std::string &host, int port) const;
 
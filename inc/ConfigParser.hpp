@@ -37,11 +37,22 @@ struct Location
 // Server configuration structure
 struct ServerConfig
 {
-	std::string host;
+	std::string host; // "unix:/path.sock" for a Unix socket listener, port is then 0
 	int port;
+	int listen_backlog; // listen(2) backlog, 'listen ... backlog=N'
+	int defer_accept;	// TCP_DEFER_ACCEPT seconds, 'listen ... deferred[=N]', 0 disables
+	// Socket options set on the listener, which accepted connections inherit.
+	// 0 keeps the system default.
+	bool tcp_nodelay;  // 'listen ... nodelay=on|off', on by default
+	int sndbuf;		   // SO_SNDBUF, 'listen ... sndbuf=size'
+	int rcvbuf;		   // SO_RCVBUF, 'listen ... rcvbuf=size'
+	int fastopen;	   // TCP_FASTOPEN queue length, 'listen ... fastopen=N'
+	int notsent_lowat; // TCP_NOTSENT_LOWAT, 'listen ... notsent_lowat=size'
+	int busy_poll;	   // SO_BUSY_POLL microseconds, 'listen ... busy_poll=N'
 	std::vector<std::string> server_names;
 	std::map<int, std::string> error_pages;
 	size_t client_max_body_size;
+	int max_connections; // Open connections on this listener, 0 is unlimited
 	std::vector<Location> locations;
 
 	// Direttive ereditabili
@@ -52,6 +63,10 @@ struct ServerConfig
 
 	ServerConfig();
 
+	// 'listen unix:/path.sock', see UnixSocket.hpp
+	bool isUnixSocket() const;
+	std::string getUnixPath() const;
+
 	// Finds the best matching location for a given request path.
 	// Returns a pointer to the best matching location, or nullptr if no match is found.
 	const Location *findMatchingLocation(const std::string &requestPath) const;
@@ -64,11 +79,38 @@ struct ServerConfig
 	static ResolutionResult getEmptyResolutionResult(int code);
 };
 
+// Per-phase connection deadlines, in seconds
+struct ConnectionTimeouts
+{
+	int header;			  // Whole request head, counted from its first byte
+	int body;			  // Grace period before body_min_rate is enforced
+	size_t body_min_rate; // Bytes per second a body must sustain, 0 disables
+	int keepalive;		  // Idle time allowed between two requests, sent as 'Keep-Alive: timeout='
+	int send;			  // Longest stall while writing a response
+
+	ConnectionTimeouts();
+};
+
 // Main configuration structure
 struct Config
 {
 	std::vector<ServerConfig> servers;
 
+	// Global directives (outside server blocks)
+	std::string event_backend;
+	int worker_processes; // 0 means 'auto' (one per online CPU)
+	int worker_threads;	  // Event-loop threads per process, 0 means 'auto'
+	ConnectionTimeouts timeouts;
+	int shutdown_timeout; // Seconds a draining process waits for in-flight responses
+	int keepalive_requests; // Requests served per connection before it is closed, 0 is unlimited
+	int max_connections;		// Open connections per process, 0 is unlimited
+	int max_connections_per_ip; // Open connections per client address, 0 is unlimited
+	int worker_rlimit_nofile;	// RLIMIT_NOFILE to raise to at startup, 0 means the hard limit
+	bool shortest_first_writes; // 'write_scheduling srpt', see Server::flushWriteQueue()
+	size_t output_high_water;	// 'output_water_marks high low', 0 disables, see Server::processBufferedRequests()
+	size_t output_low_water;
+	std::vector<std::string> worker_cpu_affinity; // "auto", one bitmask per event loop, or empty for off
+
 	Config();
 };
 
@@ -84,6 +126,7 @@ private:
 	{
 		bool listen_found;
 		bool client_max_body_size_found;
+		bool max_connections_found;
 		bool root_found;
 		bool index_found;
 		bool autoindex_found;
@@ -117,6 +160,12 @@ private:
 	Config parseConfig();
 	ServerConfig parseServer();
 	Location parseLocation(const ServerConfig &server);
+	int parseWorkerCount(const std::string &directive, const std::string &value);
+	int parseTimeout(const std::string &directive, const std::string &value);
+	std::vector<std::string> parseCpuAffinity(const std::string &value);
+	int parseConnectionLimit(const std::string &directive, const std::string &value);
+	void parseGlobalDirective(Config &config, const std::string &directive, const std::string &value);
+	void parseListenDirective(ServerConfig &server, const std::string &value);
 	void parseServerDirective(ServerConfig &server, const std::string &directive, const std::string &value, ServerParseState &state);
 	void parseLocationDirective(Location &location, const std::string &directive, const std::string &value, LocationParseState &state);
 
@@ -131,6 +180,7 @@ private:
 	bool isValidMethod(const std::string &method) const;
 	bool isValidPort(int port) const;
 	size_t parseSize(const std::string &sizeStr) const;
+	int parseSocketSize(const std::string &sizeStr) const;
 
 public:
 	ConfigParser();
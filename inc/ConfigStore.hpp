@@ -0,0 +1,57 @@
+#ifndef CONFIG_STORE_HPP
+#define CONFIG_STORE_HPP
+
+#include <ConfigManager.hpp>
+#include <string>
+#include <pthread.h>
+
+// Holds the current configuration and swaps it on reload. Each version is an
+// immutable, reference-counted Snapshot: an event loop holds one and trades
+// it for the newest between two iterations, so requests never see a config
+// change halfway and an old snapshot is freed once its last holder lets go.
+class ConfigStore
+{
+public:
+	struct Snapshot
+	{
+		ConfigManager config;
+		unsigned long generation;
+		int refCount; // Guarded by the store's mutex
+	};
+
+private:
+	std::string _path;
+	Snapshot *_current;
+	unsigned long _generation; // Written under the mutex, read lock-free
+	bool _unixListenersFixed;
+	pthread_mutex_t _mutex;
+
+	void unref(Snapshot *snapshot);
+
+	ConfigStore(const ConfigStore &);
+	ConfigStore &operator=(const ConfigStore &);
+
+public:
+	// Loads path; throws like ConfigManager::loadConfig() when it is invalid
+	ConfigStore(const std::string &path);
+	~ConfigStore();
+
+	// Re-reads the file. An invalid file is reported and the current
+	// snapshot kept. Returns true when a new snapshot was installed.
+	bool reload();
+
+	// With worker_processes the master opens the Unix sockets before forking
+	// and workers cannot be handed new ones: reload() then refuses a file
+	// that adds or removes a 'listen unix:' server block
+	void setUnixListenersFixed(bool fixed);
+
+	// The caller owns one reference to the result until release()
+	Snapshot *acquire();
+	Snapshot *retain(Snapshot *snapshot); // One more reference to a snapshot already held
+	void release(Snapshot *snapshot);
+
+	// Cheap check for a newer snapshot than the one held
+	unsigned long getGeneration() const;
+};
+
+#endif
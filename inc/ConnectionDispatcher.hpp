@@ -0,0 +1,18 @@
+#ifndef CONNECTION_DISPATCHER_HPP
+#define CONNECTION_DISPATCHER_HPP
+
+#include <string>
+#include <AdmissionControl.hpp>
+
+// Receives connections accepted by a Server that does not serve them itself
+// (the acceptor of the threaded reactor). Takes ownership of clientFd and
+// of its admission, released when the connection closes.
+class ConnectionDispatcher
+{
+public:
+	virtual ~ConnectionDispatcher() {}
+
+	virtual bool dispatch(int clientFd, const std::string &ip, int port, const AdmissionControl::Ticket &admission) = 0;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef CONNECTION_POOL_HPP
+#define CONNECTION_POOL_HPP
+
+#include <vector>
+#include <cstddef>
+
+class ClientConnection;
+
+// Free-list of preallocated ClientConnection objects. Objects are created in
+// blocks and only returned to the heap with the pool, so accepting and
+// closing connections does not allocate once the pool has warmed up.
+class ConnectionPool
+{
+private:
+	static const size_t _BLOCK_SIZE;
+	static const size_t _MAX_IDLE_BUFFER; // Larger buffers are freed on release
+
+	std::vector<ClientConnection *> _blocks;
+	std::vector<ClientConnection *> _free;
+	size_t _capacity;
+
+	void grow();
+
+	ConnectionPool(const ConnectionPool &);
+	ConnectionPool &operator=(const ConnectionPool &);
+
+public:
+	ConnectionPool();
+	~ConnectionPool();
+
+	// Returns an object reset for fd
+	ClientConnection *acquire(int fd);
+	// Closes the connection's socket and makes the object available again
+	void release(ClientConnection *client);
+
+	size_t getCapacity() const;
+	size_t getInUse() const;
+};
+
+#endif
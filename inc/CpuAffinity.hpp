@@ -0,0 +1,30 @@
+#ifndef CPU_AFFINITY_HPP
+#define CPU_AFFINITY_HPP
+
+#include <string>
+#include <vector>
+#include <sched.h>
+
+// 'worker_cpu_affinity': pins each event loop to CPUs. Slot n is the n-th
+// loop of the whole server: worker n, or loop thread t of worker w as slot
+// w * worker_threads + t. 'auto' gives slot n the n-th CPU the process may
+// run on, wrapping around; explicit masks are nginx style ("0101", CPU 0
+// rightmost), one per slot, the last repeated for the remaining ones.
+// Loops are pinned before they serve, so under the kernel's default local
+// allocation policy the pools and buffers they grow stay on their NUMA node.
+namespace CpuAffinity
+{
+	// The CPUs slot may run on, false when affinity is off
+	bool getSlotCpus(const std::vector<std::string> &affinity, int slot, cpu_set_t &cpus);
+
+	// The only CPU slot runs on, -1 when unpinned or spread over several
+	int getSlotCpu(const std::vector<std::string> &affinity, int slot);
+
+	// Pins the calling thread, inherited by the threads it starts later
+	bool pinCurrentThread(const std::vector<std::string> &affinity, int slot);
+
+	// CPU whose receive path handled fd's packets (SO_INCOMING_CPU), -1 if unknown
+	int getIncomingCpu(int fd);
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef EPOLL_POLLER_HPP
+#define EPOLL_POLLER_HPP
+
+#include <Poller.hpp>
+
+#ifdef __linux__
+
+#include <sys/epoll.h>
+
+class EpollPoller : public Poller
+{
+private:
+	int _epollFd;
+	std::vector<struct epoll_event> _epollEvents;
+
+	static const int _MAX_EVENTS;
+
+	bool control(int op, int fd, unsigned int events);
+
+public:
+	EpollPoller();
+	~EpollPoller();
+
+	bool isValid() const;
+
+	bool add(int fd, unsigned int events);
+	bool modify(int fd, unsigned int events);
+	void remove(int fd);
+	int wait(std::vector<PollEvent> &events, int timeoutMs);
+	const char *getName() const;
+};
+
+#endif
+
+#endif
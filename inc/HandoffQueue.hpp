@@ -0,0 +1,56 @@
+#ifndef HANDOFF_QUEUE_HPP
+#define HANDOFF_QUEUE_HPP
+
+#include <cstddef>
+#include <netinet/in.h>
+#include <AdmissionControl.hpp>
+
+// Single-producer/single-consumer lock-free ring used by the acceptor thread
+// to hand accepted connections to one event-loop thread. A pipe wakes the
+// consumer's poller; it carries no data, the ring does.
+class HandoffQueue
+{
+public:
+	// Negative fds are control messages for the consuming loop
+	enum Control
+	{
+		STOP = -1, // Exit at once
+		DRAIN = -2 // Finish in-flight responses, then exit
+	};
+
+	struct Item
+	{
+		int fd;
+		int port;
+		char ip[INET_ADDRSTRLEN];
+		AdmissionControl::Ticket admission; // Released by the loop on close
+	};
+
+private:
+	static const size_t _CAPACITY = 4096; // Must be a power of two
+
+	Item _items[_CAPACITY];
+	size_t _head; // Next slot to pop, written by the consumer only
+	size_t _tail; // Next slot to push, written by the producer only
+	int _wakeFds[2];
+
+	HandoffQueue(const HandoffQueue &);
+	HandoffQueue &operator=(const HandoffQueue &);
+
+public:
+	HandoffQueue();
+	~HandoffQueue();
+
+	bool isValid() const;
+
+	// Producer side
+	bool push(const Item &item);
+	void notify();
+
+	// Consumer side
+	bool pop(Item &item);
+	int getWakeFd() const;
+	void drainWakeFd();
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef IDLE_LIST_HPP
+#define IDLE_LIST_HPP
+
+#include <cstddef>
+
+// Keep-alive connections in the order they went idle, oldest first. The
+// nodes live in the connections, so linking and unlinking are O(1) and
+// never allocate.
+class IdleList
+{
+public:
+	struct Node
+	{
+		Node *prev;
+		Node *next;
+		int fd;
+
+		Node();
+		bool isLinked() const;
+	};
+
+private:
+	Node _head; // Sentinel of a circular list
+	size_t _count;
+
+	IdleList(const IdleList &);
+	IdleList &operator=(const IdleList &);
+
+public:
+	IdleList();
+	~IdleList();
+
+	void pushBack(Node &node);
+	void remove(Node &node);
+
+	// Oldest idle connection's fd, -1 if empty
+	int front() const;
+	size_t size() const;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef MASTER_HPP
+#define MASTER_HPP
+
+#include <string>
+#include <vector>
+#include <ctime>
+#include <sys/types.h>
+#include <signal.h>
+
+class ConfigStore;
+
+// Pre-fork supervisor: forks one Server per worker slot, each binding its
+// own SO_REUSEPORT listeners, and respawns workers that crash.
+class Master
+{
+private:
+	struct Worker
+	{
+		pid_t pid;
+		time_t startedAt;
+	};
+
+	ConfigStore &_configStore;
+	std::string _eventBackend;
+	std::vector<Worker> _workers;
+	std::vector<int> _inheritedListeners; // LISTEN_FDS, shared by all workers
+	pid_t _upgradePid;					  // New binary taking over, -1 if none
+	int _readyPipe[2];					  // Workers report bound listeners, open during start-up only
+
+	// A worker dying sooner than this after being forked is respawned with a delay
+	static const int _RESPAWN_THROTTLE_SECONDS;
+
+	// Signal Handling
+	static volatile sig_atomic_t _stopRequested; // The signal that asked to stop, 0 if none
+	static volatile sig_atomic_t _reloadRequested;
+	static volatile sig_atomic_t _upgradeRequested;
+	static void signalHandler(int signal);
+	void installSignalHandlers();
+
+	// AF_UNIX has no SO_REUSEPORT, these are opened once and shared by the workers
+	bool openUnixListeners();
+
+	// Worker Management
+	bool waitForWorkers();
+	void closeReadyPipe();
+	bool spawnWorker(size_t slot);
+	int runWorker(size_t slot);
+	bool reapWorker(pid_t pid, int status);
+	void stopWorkers(); // Forwards SIGINT as is, anything else as SIGTERM (drain)
+	void reloadWorkers();
+	void startUpgrade();
+	int findWorkerSlot(pid_t pid) const;
+	size_t getAliveWorkerCount() const;
+
+	void logError(const std::string &message) const;
+
+public:
+	Master(ConfigStore &configStore);
+	~Master();
+
+	void setEventBackend(const std::string &backend);
+	void setInheritedListeners(const std::vector<int> &listenFds);
+
+	// Forks workerCount workers and supervises them until SIGINT/SIGTERM,
+	// forwarding SIGHUP once the new configuration has been validated.
+	// SIGUSR2 starts a new binary next to this one (see Upgrade.hpp).
+	// Returns the process exit status.
+	int run(int workerCount);
+};
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef POLL_POLLER_HPP
+#define POLL_POLLER_HPP
+
+#include <Poller.hpp>
+#include <poll.h>
+
+class PollPoller : public Poller
+{
+private:
+	std::vector<struct pollfd> _pollFds;
+	std::vector<int> _indexByFd; // fd -> position in _pollFds, -1 if absent
+
+	static short toPollEvents(unsigned int events);
+
+public:
+	PollPoller();
+	~PollPoller();
+
+	bool add(int fd, unsigned int events);
+	bool modify(int fd, unsigned int events);
+	void remove(int fd);
+	int wait(std::vector<PollEvent> &events, int timeoutMs);
+	const char *getName() const;
+};
+
+#endif
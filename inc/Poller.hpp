@@ -0,0 +1,63 @@
+#ifndef POLLER_HPP
+#define POLLER_HPP
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// Backend independent readiness flags
+enum PollerEvent
+{
+	POLLER_READ = 0x1,
+	POLLER_WRITE = 0x2,
+	POLLER_ERROR = 0x4
+};
+
+struct PollEvent
+{
+	int fd;
+	unsigned int events;
+};
+
+// Common interface for the I/O multiplexing backends (select, poll, epoll, io_uring).
+// Interest is registered once per fd and only changed through modify(),
+// backends that need to rebuild their sets every wait() do so internally.
+class Poller
+{
+public:
+	virtual ~Poller();
+
+	virtual bool add(int fd, unsigned int events) = 0;
+	virtual bool modify(int fd, unsigned int events) = 0;
+	virtual void remove(int fd) = 0;
+
+	// Waits up to timeoutMs (-1 blocks) and fills events with the ready fds.
+	// Returns the number of ready fds, 0 on timeout or -1 with errno set.
+	virtual int wait(std::vector<PollEvent> &events, int timeoutMs) = 0;
+
+	virtual const char *getName() const = 0;
+
+	// Completion-based I/O, only io_uring provides it. Once watchAccept() or
+	// watchRecv() returned true for a registered fd, POLLER_READ on it means
+	// takeAccepted() or takeReceived() has something, and the caller uses
+	// them instead of accept() and recv(). The readiness backends refuse.
+	virtual bool watchAccept(int listenFd);
+	virtual bool watchRecv(int fd);
+
+	// Like accept4(SOCK_NONBLOCK | SOCK_CLOEXEC) without the peer address.
+	// Returns -1 with errno set, EAGAIN once drained.
+	virtual int takeAccepted(int listenFd);
+
+	// Like recv(): appends at most maxBytes to buffer and returns how many,
+	// 0 at end of stream or -1 with errno set, EAGAIN once drained.
+	virtual ssize_t takeReceived(int fd, std::string &buffer, size_t maxBytes);
+
+	// Returns a new backend by name ("select", "poll", "epoll", "io_uring"),
+	// or NULL if the name is unknown or unsupported on this platform.
+	// io_uring falls back to epoll when the running kernel cannot provide it.
+	static Poller *create(const std::string &backend);
+	static bool isSupported(const std::string &backend);
+	static const char *getDefaultBackend();
+};
+
+#endif
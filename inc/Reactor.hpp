@@ -0,0 +1,70 @@
+#ifndef REACTOR_HPP
+#define REACTOR_HPP
+
+#include <ConnectionDispatcher.hpp>
+#include <AdmissionControl.hpp>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+class ConfigStore;
+class Server;
+class HandoffQueue;
+
+// Threaded mode: the calling thread runs an acceptor Server that owns the
+// listeners and hands every accepted connection to one of N event-loop
+// threads. Each loop thread owns its own Server (poller + client table)
+// and receives connections through a lock-free HandoffQueue.
+class Reactor : public ConnectionDispatcher
+{
+private:
+	struct Loop
+	{
+		Server *server;
+		HandoffQueue *queue;
+		pthread_t thread;
+		bool started;
+		int cpu; // Pinned to this CPU alone, -1 if not
+	};
+
+	ConfigStore &_configStore;
+	std::string _eventBackend;
+	bool _reusePort;
+	bool _upgradable;
+	int _readyFd; // Master's readiness pipe, -1 if none
+	std::vector<int> _inheritedListeners;
+	std::vector<std::string> _cpuAffinity; // See CpuAffinity.hpp
+	int _firstCpuSlot;					   // Affinity slot of loop thread 0
+	std::vector<Loop> _loops;
+	AdmissionControl _admission; // Acceptor admits, loops release
+	size_t _nextLoop;
+
+	static void *loopMain(void *arg);
+
+	bool startLoops(int threadCount);
+	void stopLoops(bool drain);
+
+	Reactor(const Reactor &);
+	Reactor &operator=(const Reactor &);
+
+public:
+	Reactor(ConfigStore &configStore);
+	~Reactor();
+
+	void setEventBackend(const std::string &backend);
+	void setReusePort(bool reusePort);
+	void setInheritedListeners(const std::vector<int> &listenFds);
+	void setUpgradable(bool upgradable);
+	void setReadyFd(int readyFd);
+	void setCpuAffinity(const std::vector<std::string> &affinity, int firstSlot);
+
+	// Hands a connection to the loop pinned to the CPU that received it,
+	// round-robin when there is none
+	bool dispatch(int clientFd, const std::string &ip, int port, const AdmissionControl::Ticket &admission);
+
+	// Starts threadCount loop threads and runs the acceptor until a signal.
+	// Returns the process exit status.
+	int run(int threadCount);
+};
+
+#endif
@@ -36,6 +36,7 @@ public:
 	// containing all values associated with that header.
 	// If the header is not found an empty vector is returned.
 	std::vector<std::string> getHeaderValues(const std::string &headerName) const;
+	bool hasConnectionOption(const std::string &option) const; // Case-insensitive, e.g. "close"
 
 	// Getters
 	const std::string &getMethod() const;
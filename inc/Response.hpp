@@ -45,9 +45,13 @@ private:
 	// Error Handling
 	bool _errorFound;
 	bool _connectionError;
+	bool _closeConnection; // Answer with 'Connection: close' whatever the client asked
+	int _keepAliveMax;	   // Requests the connection may still serve, 'Keep-Alive: max=', 0 if unlimited
 
-	// CGI Handling
+	// CGI Handling: the script runs while the loop serves others
 	bool _isCGIRequest;
+	bool _ready; // False while suspended on _cgi, see resume()
+	CGIHandler::Process _cgi;
 
 	// Method Handlers
 	void handleGet();
@@ -79,15 +83,29 @@ private:
 	void readFileError();
 
 	std::string generateDynamicErrorPageBody() const;
+	std::string getConnectionHeader() const;
 
 public:
-	Response(const ConfigManager &configManager, const Request &request);
+	// The client decides whether the connection persists (see isKeepAlive()),
+	// and routes a request taken on a Unix socket (see getUnixListener())
+	Response(const ConfigManager &configManager, const Request &request, const ClientConnection &client);
 	Response(const Response &src);
 	Response &operator=(const Response &src);
 	~Response();
 
-	// Returns the properly formatted response as a string
+	// Returns the properly formatted response as a string, once isReady()
 	std::string get() const;
+
+	// The response told the client the connection closes after it
+	bool closesConnection() const;
+
+	// A handler that would block suspends instead: the loop watches the
+	// pipes of getCGIProcess() and calls resume() when one is ready or
+	// getDeadline() passes, until the response is ready
+	bool isReady() const;
+	void resume(unsigned long nowMs);
+	unsigned long getDeadline(unsigned long nowMs) const;
+	CGIHandler::Process &getCGIProcess();
 };
 
 #endif
\ No newline at end of file
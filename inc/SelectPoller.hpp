@@ -0,0 +1,30 @@
+#ifndef SELECT_POLLER_HPP
+#define SELECT_POLLER_HPP
+
+#include <Poller.hpp>
+#include <sys/select.h>
+
+// Portability fallback, limited to fds below FD_SETSIZE
+class SelectPoller : public Poller
+{
+private:
+	fd_set _masterReadFds;
+	fd_set _masterWriteFds;
+	fd_set _readFds;
+	fd_set _writeFds;
+	int _maxFd;
+
+	void recomputeMaxFd();
+
+public:
+	SelectPoller();
+	~SelectPoller();
+
+	bool add(int fd, unsigned int events);
+	bool modify(int fd, unsigned int events);
+	void remove(int fd);
+	int wait(std::vector<PollEvent> &events, int timeoutMs);
+	const char *getName() const;
+};
+
+#endif
@@ -6,61 +6,160 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <signal.h>
+#include <Poller.hpp>
+#include <TimerWheel.hpp>
+#include <ConnectionPool.hpp>
+#include <ConfigStore.hpp>
+#include <AdmissionControl.hpp>
+#include <IdleList.hpp>
 
 class ClientConnection;
 class Buffer;
 class ConfigManager;
+class ConnectionDispatcher;
+class HandoffQueue;
+class Request;
+class Response;
 struct ServerConfig; // Forward declare ServerConfig
 
+// A request whose handler suspended on a CGI script, see Server::processRequest().
+// Keeps what the Response refers to alive until the loop resumes it to completion.
+struct PendingResponse
+{
+	ConfigStore::Snapshot *snapshot; // The configuration the request was routed with
+	Request *request;
+	Response *response;
+	int watchedInputFd; // Pipes registered with the poller, -1 if none
+	int watchedOutputFd;
+};
+
 class Server
 {
 private:
-	// Server Config
-	const ConfigManager &_configManager;
+	// Server Config: the snapshot held by this loop, traded on reload
+	ConfigStore &_configStore;
+	ConfigStore::Snapshot *_snapshot;
+	const ConfigManager *_config;
 	std::map<int, const ServerConfig *> _listeningSockets; // Map listening FDs to their configs
 
 	// Static Configuration
 	static const int _REUSE_ADDR_OPT;
-	static const int _MAX_CLIENT_CONN_QUEUE;
+	static const int _MAX_ACCEPTS_PER_EVENT;
 	static const int _TIMEOUT_SECONDS;
 	static const size_t _BUFFER_SIZE;
 
-	// I/O Multiplexing
-	fd_set _readFds, _writeFds;
-	fd_set _masterReadFds, _masterWriteFds;
-	fd_set _exceptFds;
-	int _maxFd;
+	// Work one client may get per loop iteration before the others are served
+	static const int _MAX_REQUESTS_PER_TURN;
+	static const size_t _MAX_BYTES_PER_TURN;
+	static const size_t _BULK_SEND_CHUNK; // Per send() with 'write_scheduling srpt'
 
-	// Client Management
-	std::map<int, ClientConnection *> _clients;
+	// I/O Multiplexing
+	Poller *_poller;
+	std::string _eventBackend;
+	bool _completionAccept; // Some listener accepts through the poller, see acceptClient()
+	std::vector<PollEvent> _events;
+
+	// Threaded Reactor: an acceptor dispatches connections, a loop receives them
+	ConnectionDispatcher *_dispatcher;
+	HandoffQueue *_handoffQueue;
+
+	// Event Loop Statistics
+	unsigned long _loopIterations;
+	unsigned long _loopCpuMicros;
+	unsigned long _backpressurePauses; // Clients that reached the output high water mark
+	size_t _peakPendingOutput;		   // Largest output queued for one client
+
+	// Client Management: a dense table indexed by fd, NULL where unused
+	std::vector<ClientConnection *> _clients;
+	int _clientCount;
+	ConnectionPool _pool;
 	std::vector<int> _clientsToRemove;
+	std::vector<int> _deferredClients; // Resumed next iteration, see processBufferedRequests()
+	std::vector<std::pair<size_t, int> > _writeQueue; // Pending bytes and fd of writable clients
+	AdmissionControl _ownAdmission;
+	AdmissionControl *_admission; // _ownAdmission unless shared by a Reactor
+	IdleList _idleClients;		  // CONN_KEEP_ALIVE clients, evicted oldest first
+	std::map<int, int> _pipeClients; // CGI pipe fd to the client waiting on it
+
+	// Fd Pressure: below _fdLowWater free fds idle clients are evicted and
+	// keep-alive shortened; _spareFd is given up to refuse a connection on EMFILE
+	int _fdLimit;
+	int _fdLowWater;
+	int _spareFd;
+	static const int _MIN_FD_LOW_WATER;
 
 	// Server State
 	bool _running;
 	bool _initialized;
 	bool _shutdownRequested;
+	bool _reusePort; // Set SO_REUSEPORT so several workers can bind the same address
+	int _incomingCpu; // CPU this worker is pinned to, preferred by its SO_REUSEPORT listeners
+	bool _draining;	 // Listeners closed, waiting for in-flight responses
+	unsigned long _drainDeadline;
+
+	// Binary Upgrade
+	std::vector<int> _inheritedListeners; // Upgrade or LISTEN_FDS, adopted by address in initialize()
+	bool _upgradable;					  // Handles SIGUSR2, see Upgrade.hpp
+	pid_t _upgradePid;					  // New binary taking over, -1 if none
 
 	// Timing
-	struct timeval _timeout;
-	time_t _lastCleanup;
+	struct timeval _timeout; // Upper bound for a single poller wait
+	TimerWheel _timers;		 // One deadline per client, see touchClient()
 
-	// Signal Handling
-	static bool _signalReceived;
+	// Signal Handling: SIGINT stops at once, SIGTERM drains
+	static volatile sig_atomic_t _signalReceived;
+	static volatile sig_atomic_t _reloadRequested;	// SIGHUP
+	static volatile sig_atomic_t _upgradeRequested; // SIGUSR2
 	static void signalHandler(int signal);
 
+	// Listeners and Reload
+	int openListener(const ServerConfig &config);
+	int adoptListener(const ServerConfig &config);
+	void configureListener(int listenFd, const ServerConfig &config);
+	void setListenerOption(int listenFd, int level, int option, int value, const char *name, const ServerConfig &config);
+	void closeInheritedListeners();
+	void startUpgrade();
+	void checkUpgrade();
+	void updateListeners();
+	void adoptConfig();
+
 	// Connection Management
-	void handleNewConnection(int listenFd); // Modified signature
+	int acceptClient(int listenFd, struct sockaddr_in &clientAddress);
+	void handleNewConnection(int listenFd);
 	void handleClientRead(int clientFd);
 	void handleClientWrite(int clientFd);
 	void removeClient(int clientFd);
+	void touchClient(ClientConnection *client);
+	unsigned long getKeepAliveTimeoutMs() const;
+	size_t evictIdleClients(size_t count);
+	void relieveFdPressure();
+	void refuseWithSpareFd(int listenFd);
 	void cleanupTimedOutClients();
 	void processClientRemovalQueue();
-	void processRequest(int clientFd, const std::string &rawRequest);
+	void processBufferedRequests(int clientFd);
+	void processDeferredClients();
+	void scheduleClientWrite(ClientConnection *client);
+	void flushWriteQueue();
+	size_t processRequest(int clientFd, const std::string &rawRequest);
+	size_t queueResponse(ClientConnection *client, const Response &response);
 	bool isAlreadyMarkedForRemoval(int clientFd);
 
+	// Suspended Requests: resumed on pipe readiness or their deadline
+	void resumePendingResponse(int clientFd);
+	void watchPendingResponse(ClientConnection *client);
+	void watchPipe(int clientFd, int &watchedFd, int &pipeFd, int waitingFd, unsigned int events);
+	void releasePendingResponse(ClientConnection *client);
+
 	// I/O Multiplexing helpers
-	void setupFdSets();
-	void processFdSets(); // Modified signature
+	bool registerFd(int fd, unsigned int events);
+	void updateClientInterest(ClientConnection *client);
+	void processEvents();
+	void drainHandoffQueue();
+	void closeListeners();
+	bool isIdle(const ClientConnection *client) const;
+	bool isDrained() const;
+	void printLoopStatistics() const;
 
 	// Error Handling
 	void handleSocketError(int clientFd, const std::string &operation);
@@ -69,7 +168,7 @@ private:
 	int totalRequestsCount;
 
 public:
-	Server(const ConfigManager &configManager);
+	Server(ConfigStore &configStore);
 	~Server();
 
 	// Lifecycle
@@ -77,6 +176,8 @@ public:
 	void run();
 	void stop();
 	void shutdown();
+	void drain(); // Graceful stop, bounded by the 'shutdown_timeout' directive
+	bool isDraining() const;
 
 	// Client Management
 	bool addClient(int clientFd);
@@ -87,9 +188,17 @@ public:
 	int getClientCount() const;
 	bool isRunning() const;
 	bool isInitialized() const;
-	int getMaxFd() const;
 	void setTimeout(int seconds);
 	void setBufferSize(size_t size);
+	void setEventBackend(const std::string &backend);
+	void setReusePort(bool reusePort);
+	void setIncomingCpu(int cpu);
+	void setDispatcher(ConnectionDispatcher *dispatcher);
+	void setHandoffQueue(HandoffQueue *queue);
+	void setAdmissionControl(AdmissionControl *admission);
+	void setInheritedListeners(const std::vector<int> &listenFds);
+	void setUpgradable(bool upgradable);
+	const std::string &getEventBackend() const;
 	bool setNonBlocking(int fd); // Moved to public, as it's a utility
 };
 
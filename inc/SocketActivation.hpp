@@ -0,0 +1,18 @@
+#ifndef SOCKET_ACTIVATION_HPP
+#define SOCKET_ACTIVATION_HPP
+
+#include <vector>
+
+// LISTEN_FDS protocol (systemd and compatible supervisors): listening
+// sockets are passed already bound as fds 3..3+LISTEN_FDS-1, for the process
+// named by LISTEN_PID. The Server adopts them by address like inherited
+// upgrade listeners, so ports stay open and queue connections across
+// restarts of the process.
+namespace SocketActivation
+{
+	// Appends the passed fds to listenFds and clears the variables so
+	// children do not pick them up. Returns the number of fds taken.
+	int takeListeners(std::vector<int> &listenFds);
+}
+
+#endif
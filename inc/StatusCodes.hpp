@@ -16,10 +16,12 @@ namespace StatusCodes
 		FORBIDDEN = 403,
 		NOT_FOUND = 404,
 		METHOD_NOT_ALLOWED = 405,
+		REQUEST_TIMEOUT = 408,
 		CONFLICT = 409,
 		PAYLOAD_TOO_LARGE = 413,
 		INTERNAL_SERVER_ERROR = 500,
 		NOT_IMPLEMENTED = 501,
+		SERVICE_UNAVAILABLE = 503,
 		GATEWAY_ERROR = 504
 	};
 
@@ -0,0 +1,69 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <vector>
+#include <cstddef>
+#include <ctime>
+
+// Hierarchical timing wheel for connection deadlines.
+// schedule() and cancel() are O(1); advance() costs O(expired) plus one step
+// per elapsed tick, with timers in the upper levels cascaded down as their
+// slot comes due. Nodes are intrusive, so arming a timer never allocates.
+class TimerWheel
+{
+public:
+	struct Node
+	{
+		Node *prev;
+		Node *next;
+		unsigned long expiry; // Absolute tick
+		int fd;				  // Returned by advance() when the timer fires
+
+		Node();
+		bool isLinked() const;
+	};
+
+	static const unsigned long TICK_MS = 100;
+
+private:
+	static const int _LEVELS = 3;
+	static const int _LEVEL0_BITS = 8; // 256 ticks = 25.6 s
+	static const int _LEVELN_BITS = 6; // x64 per level, ~29 h in total
+
+	// Each slot is a circular list headed by a sentinel node
+	std::vector<Node> _slots[_LEVELS];
+	unsigned long _currentTick;
+	size_t _count;
+
+	static int getLevelShift(int level);
+	static size_t getLevelSize(int level);
+
+	void link(Node &node);
+	static void unlink(Node &node);
+	void cascade(int level);
+
+	TimerWheel(const TimerWheel &);
+	TimerWheel &operator=(const TimerWheel &);
+
+public:
+	TimerWheel(unsigned long nowMs);
+	~TimerWheel();
+
+	// Arms (or re-arms) node to fire at deadlineMs
+	void schedule(Node &node, unsigned long deadlineMs);
+	void cancel(Node &node);
+
+	// Fires every timer due at nowMs, appending their fds to expired
+	void advance(unsigned long nowMs, std::vector<int> &expired);
+
+	// Milliseconds until the wheel next needs to advance, -1 if empty.
+	// May be earlier than the next deadline when a cascade is due.
+	long getNextTimeoutMs(unsigned long nowMs) const;
+
+	size_t size() const;
+
+	// CLOCK_MONOTONIC in milliseconds, the time base for every deadline
+	static unsigned long getMonotonicMillis();
+};
+
+#endif
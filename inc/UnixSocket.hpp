@@ -0,0 +1,24 @@
+#ifndef UNIX_SOCKET_HPP
+#define UNIX_SOCKET_HPP
+
+#include <string>
+
+// 'listen unix:/path.sock': AF_UNIX listeners for a reverse proxy on the
+// same host, sparing it the TCP loopback stack and ephemeral ports. The
+// socket file is left in place on exit so a binary upgrade can hand the
+// listener over; a stale one is replaced by the next bind.
+namespace UnixSocket
+{
+	static const char *const PREFIX = "unix:"; // ServerConfig::host of such a listener
+
+	// Binds path and listens, non-blocking and close-on-exec.
+	// Returns the fd, or -1 with errno set (EADDRINUSE when a live
+	// process still accepts on path).
+	int listen(const std::string &path, int backlog);
+
+	// The path fd (a listener or a connection accepted on it) is bound
+	// to, empty when fd is not a Unix stream socket
+	std::string getBoundPath(int fd);
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef UPGRADE_HPP
+#define UPGRADE_HPP
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// Zero-downtime binary upgrade. On SIGUSR2 the running process re-executes
+// its own binary with the listening sockets inherited and their fds listed
+// in WEBSERV_UPGRADE ("<old pid>;<fd>;<fd>;..."). The new process adopts
+// them instead of binding, and once it serves it sends SIGTERM to the old
+// one, which then drains. If the new binary fails to start, the old one
+// keeps serving.
+namespace Upgrade
+{
+	// Remembers argv and the binary's path so it can be executed again
+	void saveCommandLine(int argc, char *argv[]);
+
+	// Forks and executes the binary with only listenFds inherited.
+	// Returns the new process's pid, or -1.
+	pid_t spawn(const std::vector<int> &listenFds);
+
+	// In the new binary: consumes WEBSERV_UPGRADE, appending the inherited
+	// fds to listenFds. Returns false when this is not an upgrade.
+	bool takeInheritedListeners(std::vector<int> &listenFds);
+
+	// Asks the old binary to drain, once this one is serving
+	void notifyReady();
+
+	// In a pre-fork worker: tells the master through readyFd that the
+	// listeners are bound, then closes it. Nothing to do when readyFd is -1.
+	void reportReady(int readyFd);
+}
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef URING_POLLER_HPP
+#define URING_POLLER_HPP
+
+#include <Poller.hpp>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define WEBSERV_HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef WEBSERV_HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <string>
+
+// io_uring backend. Each registered fd has one one-shot IORING_OP_POLL_ADD
+// in flight; re-arming after every completion keeps level-triggered
+// semantics, like the other backends. Listeners given to watchAccept() get
+// a multishot IORING_OP_ACCEPT instead, and sockets given to watchRecv() a
+// multishot IORING_OP_RECV filling a provided buffer ring, so accepting
+// and reading take no syscall of their own. Interest changes are applied
+// by wait() and submitted with it: a loop iteration costs a single
+// io_uring_enter() however many fds changed.
+// Needs Linux 5.11 (IORING_FEAT_EXT_ARG for the wait timeout). Multishot
+// accept (5.19) and recv (6.0) fall back to polling when refused.
+class UringPoller : public Poller
+{
+private:
+	enum Operation
+	{
+		OP_POLL,
+		OP_ACCEPT,
+		OP_RECV,
+		OP_COUNT
+	};
+
+	struct Request
+	{
+		uint32_t generation; // Tells stale completions from current ones
+		bool armed;			 // In flight
+	};
+
+	struct Interest
+	{
+		unsigned int events;   // POLLER_* flags, may be 0 while registered
+		unsigned int pollMask; // POLLIN/POLLOUT of the poll in flight
+		bool added;			   // Registered through add() and not removed
+		bool accepting;		   // watchAccept(): multishot accept replaces POLLIN
+		bool receiving;		   // watchRecv(): multishot recv replaces POLLIN
+		bool scheduled;		   // In _apply, see apply()
+		bool listedReady;	   // In _ready, see hasCompleted()
+		Request requests[OP_COUNT];
+
+		// Completed but not taken yet
+		std::vector<int> accepted;
+		std::string received;
+		int error; // Of the last accept or recv, 0 if none
+		bool eof;
+	};
+
+	int _ringFd;
+	unsigned int _entries;
+
+	// Submission queue
+	void *_sqRing;
+	size_t _sqRingSize;
+	unsigned int *_sqHead;
+	unsigned int *_sqTail;
+	unsigned int _sqMask;
+	unsigned int *_sqArray;
+	struct io_uring_sqe *_sqes;
+	size_t _sqesSize;
+	unsigned int _sqPending; // Queued since the last io_uring_enter()
+
+	// Completion queue
+	void *_cqRing;
+	size_t _cqRingSize;
+	unsigned int *_cqHead;
+	unsigned int *_cqTail;
+	unsigned int _cqMask;
+	struct io_uring_cqe *_cqes;
+
+	// Provided buffer ring for multishot recv. Received bytes are copied out
+	// as soon as they complete, so a client that is not read cannot hold
+	// buffers and starve the others.
+	struct io_uring_buf *_bufRing; // NULL when the kernel refused it
+	char *_buffers;
+	uint16_t *_bufRingTail; // Shared with the kernel
+	uint16_t _bufTail;		// Published once per wait()
+
+	bool _acceptSupported;
+	bool _recvSupported;
+	bool _acceptConfirmed; // A multishot accept succeeded once, EINVAL is real
+	bool _recvConfirmed;
+
+	std::vector<Interest> _interest; // Indexed by fd
+	std::vector<int> _apply;		 // Fds whose requests wait() must bring up to date
+	std::vector<int> _ready;		 // Fds with completions not taken yet
+	std::vector<int> _eventIndex;	 // fd -> slot in the events being built
+
+	static const unsigned int _ENTRIES;
+	static const unsigned int _RECV_BUFFERS; // Power of two
+	static const size_t _RECV_BUFFER_SIZE;
+	static const size_t _MAX_RECEIVED; // Per fd, recv pauses above it until taken
+	static const uint16_t _BUFFER_GROUP;
+	static const int _MAX_FD;				  // Fds share user_data with the operation
+	static const uint64_t _IGNORED_USER_DATA; // Completions of cancellations
+
+	bool setup();
+	bool setupBufferRing();
+	void recycleBuffer(uint16_t id);
+	struct io_uring_sqe *getSqe();
+	int enter(unsigned int toSubmit, unsigned int minComplete, int timeoutMs);
+	bool ensureSlot(int fd);
+	void schedule(int fd);
+	void apply(int fd);
+	bool submit(int fd, Operation operation);
+	void cancel(int fd, Operation operation);
+	void complete(const struct io_uring_cqe &cqe, std::vector<PollEvent> &events);
+	bool hasCompleted(int fd) const;
+	void listReady(int fd);
+	void addEvent(std::vector<PollEvent> &events, int fd, unsigned int flags);
+	static uint64_t makeUserData(int fd, Operation operation, uint32_t generation);
+
+	UringPoller(const UringPoller &);
+	UringPoller &operator=(const UringPoller &);
+
+public:
+	UringPoller();
+	~UringPoller();
+
+	bool isValid() const;
+
+	bool add(int fd, unsigned int events);
+	bool modify(int fd, unsigned int events);
+	void remove(int fd);
+	int wait(std::vector<PollEvent> &events, int timeoutMs);
+	const char *getName() const;
+
+	bool watchAccept(int listenFd);
+	int takeAccepted(int listenFd);
+	bool watchRecv(int fd);
+	ssize_t takeReceived(int fd, std::string &buffer, size_t maxBytes);
+};
+
+#endif
+
+#endif
@@ -0,0 +1,68 @@
+#include <AdmissionControl.hpp>
+#include <climits>
+
+AdmissionControl::AdmissionControl() : _total(0), _fdHeadroom(INT_MAX)
+{
+	pthread_mutex_init(&this->_mutex, NULL);
+}
+
+AdmissionControl::~AdmissionControl()
+{
+	pthread_mutex_destroy(&this->_mutex);
+}
+
+bool AdmissionControl::admit(const Ticket &ticket, const Limits &limits)
+{
+	pthread_mutex_lock(&this->_mutex);
+	std::map<int, int>::const_iterator listener = this->_perListener.find(ticket.listener);
+	std::map<uint32_t, int>::const_iterator ip = this->_perIp.find(ticket.address);
+	int perListener = (listener != this->_perListener.end()) ? listener->second : 0;
+	int perIp = (ip != this->_perIp.end()) ? ip->second : 0;
+	bool admitted = (limits.total <= 0 || this->_total < limits.total) &&
+					(limits.perServer <= 0 || perListener < limits.perServer) &&
+					(limits.perIp <= 0 || perIp < limits.perIp);
+	// Entries are only created for admitted connections, refused ones leave no trace
+	if (admitted)
+	{
+		__atomic_add_fetch(&this->_total, 1, __ATOMIC_RELAXED);
+		this->_perListener[ticket.listener]++;
+		this->_perIp[ticket.address]++;
+	}
+	pthread_mutex_unlock(&this->_mutex);
+	return admitted;
+}
+
+void AdmissionControl::release(const Ticket &ticket)
+{
+	if (ticket.listener < 0)
+		return; // Never admitted
+	pthread_mutex_lock(&this->_mutex);
+	__atomic_sub_fetch(&this->_total, 1, __ATOMIC_RELAXED);
+	std::map<int, int>::iterator listener = this->_perListener.find(ticket.listener);
+	if (listener != this->_perListener.end() && --listener->second <= 0)
+		this->_perListener.erase(listener);
+	std::map<uint32_t, int>::iterator ip = this->_perIp.find(ticket.address);
+	if (ip != this->_perIp.end() && --ip->second <= 0)
+		this->_perIp.erase(ip);
+	pthread_mutex_unlock(&this->_mutex);
+}
+
+int AdmissionControl::getTotal() const
+{
+	return __atomic_load_n(&this->_total, __ATOMIC_RELAXED);
+}
+
+void AdmissionControl::setFdHeadroom(int headroom)
+{
+	__atomic_store_n(&this->_fdHeadroom, headroom, __ATOMIC_RELAXED);
+}
+
+void AdmissionControl::addFdHeadroom(int freed)
+{
+	__atomic_add_fetch(&this->_fdHeadroom, freed, __ATOMIC_RELAXED);
+}
+
+int AdmissionControl::getFdHeadroom() const
+{
+	return __atomic_load_n(&this->_fdHeadroom, __ATOMIC_RELAXED);
+}
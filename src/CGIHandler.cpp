@@ -6,9 +6,22 @@
 #include <cstdlib>
 #include <errno.h>
 #include <ctime>
+#include <fcntl.h>
+#include <signal.h>
+#include <TimerWheel.hpp>
 
-// Timeout for the CGI process in seconds
-#define CGI_TIMEOUT 5
+const unsigned long CGIHandler::TIMEOUT_MS = 5000;
+const unsigned long CGIHandler::REAP_RETRY_MS = TimerWheel::TICK_MS;
+
+CGIHandler::Process::Process() : pid(-1),
+								 inputFd(-1),
+								 outputFd(-1),
+								 inputOffset(0),
+								 outputClosed(false),
+								 status(0),
+								 startedAt(0)
+{
+}
 
 CGIHandler::CGIHandler() {}
 
@@ -70,50 +83,72 @@ void CGIHandler::childProcess(int *pipe_in, int *pipe_out, const std::string &sc
 	}
 }
 
-std::string CGIHandler::readFromPipe(int pipe_fd)
+// Non-blocking: takes what the script has written so far, EOF sets outputClosed
+bool CGIHandler::readFromPipe(Process &process)
 {
-	std::string output;
 	char buffer[4096];
 	ssize_t bytesRead;
 
-	while ((bytesRead = read(pipe_fd, buffer, sizeof(buffer) - 1)) > 0)
+	while ((bytesRead = read(process.outputFd, buffer, sizeof(buffer))) > 0)
+		process.output.append(buffer, bytesRead);
+	if (bytesRead == 0)
 	{
-		buffer[bytesRead] = '\0';
-		output.append(buffer, bytesRead);
+		process.outputClosed = true;
+		return true;
 	}
-	if (bytesRead == -1)
-	{
-		std::cerr << "read from pipe failed: " << strerror(errno) << std::endl;
-		throw std::runtime_error("Error reading from CGI pipe.");
-	}
-	return output;
+	if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+		return true;
+	std::cerr << "read from pipe failed: " << strerror(errno) << std::endl;
+	return false;
 }
 
-void CGIHandler::writeToPipe(int pipe_fd, const std::string &data)
+// Non-blocking: feeds as much of the request body as the pipe takes
+bool CGIHandler::writeToPipe(Process &process)
 {
-	if (!data.empty())
+	while (process.inputOffset < process.input.size())
 	{
-		ssize_t bytesWritten = write(pipe_fd, data.c_str(), data.length());
-		if (bytesWritten == -1)
+		ssize_t bytesWritten = write(process.inputFd, process.input.data() + process.inputOffset,
+									 process.input.size() - process.inputOffset);
+		if (bytesWritten > 0)
+		{
+			process.inputOffset += bytesWritten;
+			continue;
+		}
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return true;
+		if (errno == EPIPE)
 		{
-			std::cerr << "write to pipe failed: " << strerror(errno) << std::endl;
-			throw std::runtime_error("Error writing to CGI pipe.");
+			// The script exited or closed stdin without reading it all
+			process.inputOffset = process.input.size();
+			return true;
 		}
+		std::cerr << "write to pipe failed: " << strerror(errno) << std::endl;
+		return false;
 	}
-	close(pipe_fd); // Close the pipe to signal EOF to the child process
+	return true;
 }
 
-std::string CGIHandler::executeCGI(const std::string &scriptPath,
-								   const std::string &requestBody,
-								   const std::map<std::string, std::string> &envVars)
+bool CGIHandler::spawn(const std::string &scriptPath,
+					   const std::string &requestBody,
+					   const std::map<std::string, std::string> &envVars,
+					   Process &process)
 {
 	int pipe_in[2];	 // Server -> CGI
 	int pipe_out[2]; // CGI -> Server
 
-	if (pipe(pipe_in) == -1 || pipe(pipe_out) == -1)
+	// Close-on-exec from the start: another loop thread may fork meanwhile,
+	// and a copy held open elsewhere would keep the pipe alive after we close it
+	if (pipe2(pipe_in, O_CLOEXEC) == -1)
 	{
 		std::cerr << "pipe creation failed: " << strerror(errno) << std::endl;
-		throw std::runtime_error("Failed to create pipes for CGI.");
+		return false;
+	}
+	if (pipe2(pipe_out, O_CLOEXEC) == -1)
+	{
+		std::cerr << "pipe creation failed: " << strerror(errno) << std::endl;
+		close(pipe_in[0]);
+		close(pipe_in[1]);
+		return false;
 	}
 
 	// Prepare argv: the first element is the script path
@@ -123,81 +158,120 @@ std::string CGIHandler::executeCGI(const std::string &scriptPath,
 	char **envp = mapToCharPtrArray(envVars);
 	pid_t pid = fork();
 
-	if (pid == -1)
-	{
-		std::cerr << "fork failed: " << strerror(errno) << std::endl;
-		freeCharPtrArray(envp);
-		free(argv[0]);
-		close(pipe_in[0]);
-		close(pipe_in[1]);
-		close(pipe_out[0]);
-		close(pipe_out[1]);
-		throw std::runtime_error("Failed to fork for CGI.");
-	}
-	else if (pid == 0)
+	if (pid == 0)
 	{
 		childProcess(pipe_in, pipe_out, scriptPath, envp, argv);
 		exit(EXIT_FAILURE);
 	}
-	else
-	{
-		// Close the file descriptors that are not used in the parent process
-		close(pipe_in[READ_END]);
-		close(pipe_out[WRITE_END]);
 
-		// Write the request body to the stdin of the child process
-		writeToPipe(pipe_in[1], requestBody);
+	// Free the environment variables and script path
+	freeCharPtrArray(envp);
+	free(argv[0]);
+	close(pipe_in[READ_END]);
+	close(pipe_out[WRITE_END]);
 
-		int status;
-		time_t startTime = time(NULL);
+	if (pid == -1)
+	{
+		std::cerr << "fork failed: " << strerror(errno) << std::endl;
+		close(pipe_in[WRITE_END]);
+		close(pipe_out[READ_END]);
+		return false;
+	}
 
-		while (true)
-		{
-			// Check if the child process has terminated
-			pid_t wait_result = waitpid(pid, &status, WNOHANG);
-			if (wait_result == pid)
-			{
-				break;
-			}
-			if (wait_result == -1)
-			{
-				std::cerr << "waitpid error: " << strerror(errno) << std::endl;
-				close(pipe_in[1]);
-				close(pipe_out[0]);
-				return "";
-			}
-
-			// Check for timeout
-			time_t currentTime = time(NULL);
-			if (difftime(currentTime, startTime) >= CGI_TIMEOUT)
-			{
-				std::cerr << "CGI script timed out" << std::endl;
-				kill(pid, SIGKILL);
-				waitpid(pid, NULL, 0);
-				close(pipe_in[1]);
-				close(pipe_out[0]);
-				return "Status: 504 Gateway Timeout\r\n\r\n";
-			}
-		}
+	fcntl(pipe_in[WRITE_END], F_SETFL, fcntl(pipe_in[WRITE_END], F_GETFL, 0) | O_NONBLOCK);
+	fcntl(pipe_out[READ_END], F_SETFL, fcntl(pipe_out[READ_END], F_GETFL, 0) | O_NONBLOCK);
 
-		// Read the output from the stdout of the child process
-		std::string cgiOutput = readFromPipe(pipe_out[0]);
+	process.pid = pid;
+	process.inputFd = pipe_in[WRITE_END];
+	process.outputFd = pipe_out[READ_END];
+	process.input = requestBody;
+	process.inputOffset = 0;
+	process.output.clear();
+	process.outputClosed = false;
+	process.status = 0;
+	process.startedAt = TimerWheel::getMonotonicMillis();
+	return true;
+}
 
-		close(pipe_out[0]);
-		
-		// Free the environment variables and script path
-		freeCharPtrArray(envp);
-		free(argv[0]);
+CGIHandler::Progress CGIHandler::resume(Process &process, unsigned long nowMs)
+{
+	if (process.pid <= 0)
+		return CGI_FAILED;
+
+	if (process.inputFd >= 0 && !writeToPipe(process))
+		process.inputOffset = process.input.size();
+	if (process.outputFd >= 0 && !process.outputClosed && !readFromPipe(process))
+	{
+		abort(process);
+		return CGI_FAILED;
+	}
 
-		if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+	// Output complete: done once the child has exited, checked again
+	// after REAP_RETRY_MS if it has not quite yet
+	if (process.outputClosed)
+	{
+		pid_t waitResult = waitpid(process.pid, &process.status, WNOHANG);
+		if (waitResult == process.pid)
 		{
-			std::cout << "CGI script executed successfully." << std::endl;
-			return cgiOutput;
+			process.pid = -1;
+			if (WIFEXITED(process.status) && WEXITSTATUS(process.status) == 0)
+				return CGI_DONE;
+			std::cerr << "CGI script failed or terminated abnormally. Status: " << process.status << std::endl;
+			return CGI_FAILED;
 		}
-		else
+		if (waitResult == -1)
 		{
-			std::cerr << "CGI script failed or terminated abnormally. Status: " << status << std::endl;
-			throw std::runtime_error("CGI execution failed.");
+			std::cerr << "waitpid error: " << strerror(errno) << std::endl;
+			process.pid = -1;
+			return CGI_FAILED;
 		}
 	}
+
+	if (nowMs >= process.startedAt + TIMEOUT_MS)
+	{
+		std::cerr << "CGI script timed out" << std::endl;
+		abort(process);
+		return CGI_TIMED_OUT;
+	}
+	return CGI_RUNNING;
+}
+
+int CGIHandler::getWaitingInputFd(const Process &process)
+{
+	if (process.inputOffset < process.input.size())
+		return process.inputFd;
+	return -1;
+}
+
+int CGIHandler::getWaitingOutputFd(const Process &process)
+{
+	if (!process.outputClosed)
+		return process.outputFd;
+	return -1;
+}
+
+unsigned long CGIHandler::getDeadline(const Process &process, unsigned long nowMs)
+{
+	if (process.outputClosed)
+		return nowMs + REAP_RETRY_MS;
+	return process.startedAt + TIMEOUT_MS;
+}
+
+void CGIHandler::abort(Process &process)
+{
+	if (process.pid > 0)
+	{
+		kill(process.pid, SIGKILL);
+		waitpid(process.pid, NULL, 0);
+		process.pid = -1;
+	}
+	closePipe(process.inputFd);
+	closePipe(process.outputFd);
+}
+
+void CGIHandler::closePipe(int &fd)
+{
+	if (fd >= 0)
+		close(fd);
+	fd = -1;
 }
@@ -1,86 +1,217 @@
 #include <ClientConnection.hpp>
+#include <Poller.hpp>
 #include <iostream>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <cstring>
 #include <unistd.h>
 #include <cerrno>
 #include <cmath>
 
+const size_t ClientConnection::_MIN_READ_SIZE = 2048;
+const size_t ClientConnection::_MAX_READ_SIZE = 64 * 1024;
+const size_t ClientConnection::_MAX_WRITE_IOVECS = 64;
+
 static time_t getCurrentTime()
 {
 	time_t now = time(NULL);
 	return now;
 }
 
+ClientConnection::ClientConnection()
+	: _fd(-1)
+{
+	this->reset(-1);
+}
+
 ClientConnection::ClientConnection(int fd)
-	: _fd(fd),
-	  _state(CONN_READING_REQUEST),
-	  _writeOffset(0),
-	  _contentLength(0),
-	  _hasContentLength(false),
-	  //   _isChunked(false),
-	  _keepAlive(false),
-	  _clientPort(0),
-	  _bytesRead(0),
-	  _bytesWritten(0),
-	  _requestCount(0)
+	: _fd(-1)
 {
+	this->reset(fd);
+}
+
+ClientConnection::~ClientConnection()
+{
+	this->close();
+}
+
+// Pooling
+void ClientConnection::reset(int fd)
+{
+	this->_fd = fd;
+	this->_state = CONN_READING_REQUEST;
+	this->_pollEvents = 0;
+	this->_pollRegistered = false;
+	this->_markedForRemoval = false;
+	this->_keepAlive = false;
+	this->_hasContentLength = false;
+	this->_deferred = false;
+	this->_writeQueued = false;
+	this->_readPaused = false;
+	// this->_isChunked = false;
+	this->_writeOffset = 0;
+	this->_contentLength = 0;
+	this->_readSize = _MIN_READ_SIZE;
+	this->_timerNode.fd = fd;
+	this->_idleNode.fd = fd;
+	this->_pendingResponse = NULL;
+	this->_receiver = NULL;
+
+	this->_requestStartedAt = TimerWheel::getMonotonicMillis();
+	this->_bodyStartedAt = 0;
+	this->_lastWriteAt = this->_requestStartedAt;
+	this->_headerLength = 0;
+
+	// clear() keeps the capacity, sparing the allocations on reuse
+	this->_readBuffer.clear();
+	this->clearWriteBuffer();
+
+	this->_clientIP.clear();
+	this->_clientPort = 0;
+	this->_unixListener.clear();
+	this->_admissionTicket.listener = -1;
+	this->_admissionTicket.address = 0;
 	// Set creation time and last activity to current time
 	time_t now = getCurrentTime();
 	this->_createdAt = now;
 	this->_lastActivity = now;
+	this->_bytesRead = 0;
+	this->_bytesWritten = 0;
+	this->_requestCount = 0;
 }
 
-ClientConnection::~ClientConnection()
+void ClientConnection::close()
 {
 	// Close socket if it's still open
 	if (this->_fd != -1)
 	{
-		close(this->_fd);
+		::close(this->_fd);
 		this->_fd = -1;
 	}
 }
 
-// I/O Operations
-bool ClientConnection::readData()
+// Drops buffers that grew past maxCapacity, so one large request does not
+// pin its memory for the lifetime of the pool
+void ClientConnection::shrinkBuffers(size_t maxCapacity)
 {
-	char buffer[4096];
-	ssize_t bytesRead = recv(this->_fd, buffer, sizeof(buffer) - 1, MSG_DONTWAIT);
+	if (this->_readBuffer.capacity() > maxCapacity)
+		std::string().swap(this->_readBuffer);
+}
 
-	if (bytesRead < 0)
+// I/O Operations
+// Receives straight into the read buffer until the socket is drained or
+// maxBytes were read. A short read means the socket is empty, which spares
+// the recv() that would only return EAGAIN: the poller is level-triggered
+// and reports anything that arrives later. EOF or an error after some data
+// was read is left for the next call, so that data is still served.
+// With a receiver the data was already received by the poller and is
+// only taken from it, the same way.
+bool ClientConnection::readData(size_t maxBytes)
+{
+	// A new request on an idle connection is usually small
+	if (this->_state == CONN_KEEP_ALIVE)
+		this->_readSize = _MIN_READ_SIZE;
+
+	size_t totalRead = 0;
+	while (maxBytes == 0 || totalRead < maxBytes)
 	{
-		this->setState(CONN_ERROR);
-		return false;
-	}
+		ssize_t bytesRead;
+		if (this->_receiver)
+			bytesRead = this->_receiver->takeReceived(this->_fd, this->_readBuffer, this->_readSize);
+		else
+		{
+			size_t used = this->_readBuffer.size();
+			this->_readBuffer.resize(used + this->_readSize);
+			bytesRead = recv(this->_fd, &this->_readBuffer[used], this->_readSize, MSG_DONTWAIT);
+			this->_readBuffer.resize(used + (bytesRead > 0 ? bytesRead : 0));
+		}
 
-	if (bytesRead == 0)
-	{
-		// Client Closed Connection
-		this->setState(CONN_CLOSING);
-		return false;
+		if (bytesRead < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || totalRead > 0)
+				break;
+			this->setState(CONN_ERROR);
+			return false;
+		}
+		if (bytesRead == 0)
+		{
+			if (totalRead > 0)
+				break;
+			// Client Closed Connection
+			this->setState(CONN_CLOSING);
+			return false;
+		}
+
+		totalRead += bytesRead;
+		if (static_cast<size_t>(bytesRead) < this->_readSize)
+			break;
+		if (this->_readSize < _MAX_READ_SIZE)
+			this->_readSize *= 2;
 	}
+	if (totalRead == 0)
+		return true; // Spurious wakeup
 
 	// Client Requested Resources
-	buffer[bytesRead] = '\0';
-	this->_readBuffer.append(buffer, bytesRead);
-	this->_bytesRead += bytesRead;
+	this->_bytesRead += totalRead;
 	this->updateActivity();
+
+	// The first byte after an idle keep-alive period starts a new request
+	unsigned long now = TimerWheel::getMonotonicMillis();
+	if (this->_state == CONN_KEEP_ALIVE)
+	{
+		this->setState(CONN_READING_REQUEST);
+		this->_requestStartedAt = now;
+	}
+	this->updateRequestPhase(now);
 	return true;
 }
 
-bool ClientConnection::writeData()
+void ClientConnection::setReceiver(Poller *receiver)
+{
+	this->_receiver = receiver;
+}
+
+bool ClientConnection::writeData(size_t maxBytes)
 {
 	if (!this->hasDataToWrite())
 	{
 		return true;
 	}
 
-	const char *data = this->_writeBuffer.c_str() + this->_writeOffset;
-	size_t remaining = this->_writeBuffer.size() - this->_writeOffset;
+	// Queued responses leave in one sendmsg(), the front one from _writeOffset on
+	struct iovec iov[_MAX_WRITE_IOVECS];
+	struct msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = iov;
+	size_t total = 0;
+	std::deque<std::string>::const_iterator it = this->_responseQueue.begin();
+	for (; it != this->_responseQueue.end() && message.msg_iovlen < _MAX_WRITE_IOVECS; ++it)
+	{
+		size_t offset = (it == this->_responseQueue.begin()) ? this->_writeOffset : 0;
+		size_t length = it->size() - offset;
+		if (maxBytes > 0 && length > maxBytes - total)
+			length = maxBytes - total;
+		iov[message.msg_iovlen].iov_base = const_cast<char *>(it->data() + offset);
+		iov[message.msg_iovlen].iov_len = length;
+		message.msg_iovlen++;
+		total += length;
+		if (maxBytes > 0 && total >= maxBytes)
+			break;
+	}
 
-	ssize_t bytesWritten = send(this->_fd, data, remaining, MSG_DONTWAIT);
+	// More of the queue follows: with TCP_NODELAY the tail of a capped
+	// write would otherwise leave as a short segment of its own
+	int flags = MSG_DONTWAIT;
+	if (total < this->_pendingWriteBytes)
+		flags |= MSG_MORE;
+
+	ssize_t bytesWritten = sendmsg(this->_fd, &message, flags);
 
 	if (bytesWritten < 0)
 	{
+		// Socket buffer full, the poller reports when it drains
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return true;
 		// Real Error
 		this->setState(CONN_ERROR);
 		return false;
@@ -92,12 +223,27 @@ bool ClientConnection::writeData()
 		return true;
 	}
 
-	this->_writeOffset += bytesWritten;
+	// Drop the responses sent in full
+	size_t sent = bytesWritten;
+	while (sent > 0)
+	{
+		size_t left = this->_responseQueue.front().size() - this->_writeOffset;
+		if (sent < left)
+		{
+			this->_writeOffset += sent;
+			break;
+		}
+		sent -= left;
+		this->_responseQueue.pop_front();
+		this->_writeOffset = 0;
+	}
+	this->_pendingWriteBytes -= bytesWritten;
 	this->_bytesWritten += bytesWritten;
+	this->_lastWriteAt = TimerWheel::getMonotonicMillis();
 	this->updateActivity();
 
 	// Check if All Data Written
-	if (this->_writeOffset >= this->_writeBuffer.size())
+	if (this->_pendingWriteBytes == 0)
 	{
 		this->clearWriteBuffer();
 		if (this->_state == CONN_WRITING_RESPONSE)
@@ -108,11 +254,13 @@ bool ClientConnection::writeData()
 	return true;
 }
 
-void ClientConnection::appendToWriteBuffer(const std::string &data)
+void ClientConnection::queueResponse(std::string &data)
 {
-	if (this->_writeBuffer.empty())
-		this->_writeOffset = 0;
-	this->_writeBuffer.append(data);
+	if (data.empty())
+		return;
+	this->_pendingWriteBytes += data.size();
+	this->_responseQueue.push_back(std::string());
+	this->_responseQueue.back().swap(data);
 }
 
 void ClientConnection::clearReadBuffer()
@@ -123,7 +271,8 @@ void ClientConnection::clearReadBuffer()
 void ClientConnection::clearWriteBuffer()
 {
 	this->_writeOffset = 0;
-	this->_writeBuffer.clear();
+	this->_pendingWriteBytes = 0;
+	this->_responseQueue.clear();
 }
 
 // State Management
@@ -148,14 +297,14 @@ const std::string &ClientConnection::getReadBuffer() const
 	return this->_readBuffer;
 }
 
-const std::string &ClientConnection::getWriteBuffer() const
+bool ClientConnection::hasDataToWrite() const
 {
-	return this->_writeBuffer;
+	return this->_pendingWriteBytes > 0;
 }
 
-bool ClientConnection::hasDataToWrite() const
+size_t ClientConnection::getPendingWriteBytes() const
 {
-	return !_writeBuffer.empty() && _writeOffset < _writeBuffer.size();
+	return this->_pendingWriteBytes;
 }
 
 bool ClientConnection::hasCompleteRequest() const
@@ -221,6 +370,16 @@ void ClientConnection::setClientInfo(const std::string &ip, int port)
 	this->_clientPort = port;
 }
 
+void ClientConnection::setAdmissionTicket(const AdmissionControl::Ticket &ticket)
+{
+	this->_admissionTicket = ticket;
+}
+
+const AdmissionControl::Ticket &ClientConnection::getAdmissionTicket() const
+{
+	return this->_admissionTicket;
+}
+
 const std::string &ClientConnection::getClientIP() const
 {
 	return this->_clientIP;
@@ -231,6 +390,16 @@ int ClientConnection::getClientPort() const
 	return this->_clientPort;
 }
 
+void ClientConnection::setUnixListener(const std::string &host)
+{
+	this->_unixListener = host;
+}
+
+const std::string &ClientConnection::getUnixListener() const
+{
+	return this->_unixListener;
+}
+
 size_t ClientConnection::getContentLength() const
 {
 	return this->_contentLength;
@@ -265,12 +434,14 @@ void ClientConnection::incrementRequestCount()
 // Helper Methods for Server Class
 bool ClientConnection::needsRead() const
 {
-	return this->_state == CONN_READING_REQUEST;
+	return (this->_state == CONN_READING_REQUEST || this->_state == CONN_KEEP_ALIVE) && !this->_readPaused;
 }
 
+// Responses queued before a suspended one are written while it runs
 bool ClientConnection::needsWrite() const
 {
-	return this->_state == CONN_WRITING_RESPONSE;
+	return this->_state == CONN_WRITING_RESPONSE ||
+		   (this->_state == CONN_PROCESSING_REQUEST && this->hasDataToWrite());
 }
 
 bool ClientConnection::shouldClose() const
@@ -281,4 +452,135 @@ bool ClientConnection::shouldClose() const
 void ClientConnection::setContentLength(int cl)
 {
 	this->_contentLength = cl;
-}
\ No newline at end of file
+}
+
+// Poller Interest
+unsigned int ClientConnection::getPollEvents() const
+{
+	return this->_pollEvents;
+}
+
+void ClientConnection::setPollEvents(unsigned int events)
+{
+	this->_pollEvents = events;
+}
+
+bool ClientConnection::isPollRegistered() const
+{
+	return this->_pollRegistered;
+}
+
+void ClientConnection::setPollRegistered(bool registered)
+{
+	this->_pollRegistered = registered;
+}
+
+// Request Phases
+void ClientConnection::updateRequestPhase(unsigned long now)
+{
+	if (this->_bodyStartedAt != 0)
+		return;
+
+	size_t headerEnd = this->_readBuffer.find("\r\n\r\n");
+	if (headerEnd == std::string::npos)
+		return;
+	this->_headerLength = headerEnd + 4;
+	this->_bodyStartedAt = now;
+}
+
+void ClientConnection::startNextRequest()
+{
+	unsigned long now = TimerWheel::getMonotonicMillis();
+	this->_requestStartedAt = now;
+	this->_bodyStartedAt = 0;
+	this->_headerLength = 0;
+	this->updateRequestPhase(now); // A pipelined head may already be buffered
+}
+
+bool ClientConnection::isReadingBody() const
+{
+	return this->_bodyStartedAt != 0;
+}
+
+unsigned long ClientConnection::getRequestStartedAt() const
+{
+	return this->_requestStartedAt;
+}
+
+unsigned long ClientConnection::getBodyStartedAt() const
+{
+	return this->_bodyStartedAt;
+}
+
+unsigned long ClientConnection::getLastWriteAt() const
+{
+	return this->_lastWriteAt;
+}
+
+size_t ClientConnection::getBodyBytesRead() const
+{
+	if (this->_readBuffer.size() < this->_headerLength)
+		return 0;
+	return this->_readBuffer.size() - this->_headerLength;
+}
+
+// Timeouts and Removal
+TimerWheel::Node &ClientConnection::getTimerNode()
+{
+	return this->_timerNode;
+}
+
+IdleList::Node &ClientConnection::getIdleNode()
+{
+	return this->_idleNode;
+}
+
+bool ClientConnection::isMarkedForRemoval() const
+{
+	return this->_markedForRemoval;
+}
+
+void ClientConnection::setMarkedForRemoval()
+{
+	this->_markedForRemoval = true;
+}
+
+bool ClientConnection::isDeferred() const
+{
+	return this->_deferred;
+}
+
+void ClientConnection::setDeferred(bool deferred)
+{
+	this->_deferred = deferred;
+}
+
+bool ClientConnection::isReadPaused() const
+{
+	return this->_readPaused;
+}
+
+void ClientConnection::setReadPaused(bool paused)
+{
+	this->_readPaused = paused;
+}
+
+bool ClientConnection::isWriteQueued() const
+{
+	return this->_writeQueued;
+}
+
+void ClientConnection::setWriteQueued(bool queued)
+{
+	this->_writeQueued = queued;
+}
+
+PendingResponse *ClientConnection::getPendingResponse() const
+{
+	return this->_pendingResponse;
+}
+
+void ClientConnection::setPendingResponse(PendingResponse *pending)
+{
+	this->_pendingResponse = pending;
+}
@@ -3,6 +3,19 @@
 #include <iostream>
 #include <stdexcept>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <UnixSocket.hpp>
+
+bool ServerConfig::isUnixSocket() const
+{
+	return this->host.compare(0, strlen(UnixSocket::PREFIX), UnixSocket::PREFIX) == 0;
+}
+
+std::string ServerConfig::getUnixPath() const
+{
+	return this->isUnixSocket() ? this->host.substr(strlen(UnixSocket::PREFIX)) : "";
+}
 
 const Location *ServerConfig::findMatchingLocation(const std::string &requestPath) const
 {
@@ -84,6 +97,81 @@ const std::vector<ServerConfig> &ConfigManager::getServers() const
 	return config.servers;
 }
 
+const std::string &ConfigManager::getEventBackend() const
+{
+	return config.event_backend;
+}
+
+static int getOnlineCpuCount()
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return cpus > 0 ? static_cast<int>(cpus) : 1;
+}
+
+int ConfigManager::getWorkerProcesses() const
+{
+	if (config.worker_processes > 0)
+		return config.worker_processes;
+	return getOnlineCpuCount();
+}
+
+int ConfigManager::getWorkerThreads() const
+{
+	if (config.worker_threads > 0)
+		return config.worker_threads;
+	return getOnlineCpuCount();
+}
+
+const ConnectionTimeouts &ConfigManager::getTimeouts() const
+{
+	return config.timeouts;
+}
+
+int ConfigManager::getShutdownTimeout() const
+{
+	return config.shutdown_timeout;
+}
+
+int ConfigManager::getKeepaliveRequests() const
+{
+	return config.keepalive_requests;
+}
+
+int ConfigManager::getMaxConnections() const
+{
+	return config.max_connections;
+}
+
+int ConfigManager::getMaxConnectionsPerIp() const
+{
+	return config.max_connections_per_ip;
+}
+
+int ConfigManager::getWorkerRlimitNofile() const
+{
+	return config.worker_rlimit_nofile;
+}
+
+bool ConfigManager::useShortestFirstWrites() const
+{
+	return config.shortest_first_writes;
+}
+
+size_t ConfigManager::getOutputHighWater() const
+{
+	return config.output_high_water;
+}
+
+size_t ConfigManager::getOutputLowWater() const
+{
+	return config.output_low_water;
+}
+
+const std::vector<std::string> &ConfigManager::getWorkerCpuAffinity() const
+{
+	return config.worker_cpu_affinity;
+}
+
 const ServerConfig *ConfigManager::findServer(const std::string &host, int port) const
 {
 	if (!is_loaded)
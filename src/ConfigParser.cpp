@@ -1,6 +1,11 @@
 #include <ConfigParser.hpp>
 #include <cctype>
 #include <sys/stat.h>
+#include <sched.h>
+#include <sys/un.h>
+#include <climits>
+#include <cstring>
+#include <UnixSocket.hpp>
 
 // Location
 Location::Location()
@@ -23,9 +28,18 @@ Location::Location()
 ServerConfig::ServerConfig()
 	: host("localhost"),
 	  port(80),
+	  listen_backlog(511),
+	  defer_accept(0),
+	  tcp_nodelay(true),
+	  sndbuf(0),
+	  rcvbuf(0),
+	  fastopen(0),
+	  notsent_lowat(0),
+	  busy_poll(0),
 	  server_names(),
 	  error_pages(),
 	  client_max_body_size(1048576),
+	  max_connections(0),
 	  locations(),
 	  root(""),
 	  index_files(),
@@ -38,6 +52,7 @@ ServerConfig::ServerConfig()
 ConfigParser::ServerParseState::ServerParseState()
 	: listen_found(false),
 	  client_max_body_size_found(false),
+	  max_connections_found(false),
 	  root_found(false),
 	  index_found(false),
 	  autoindex_found(false)
@@ -57,7 +72,16 @@ ConfigParser::LocationParseState::LocationParseState()
 }
 
 // Config
-Config::Config() : servers() {}
+ConnectionTimeouts::ConnectionTimeouts()
+	: header(10),
+	  body(10),
+	  body_min_rate(1024),
+	  keepalive(10),
+	  send(10)
+{
+}
+
+Config::Config() : servers(), event_backend(""), worker_processes(1), worker_threads(1), timeouts(), shutdown_timeout(10), keepalive_requests(1000), max_connections(0), max_connections_per_ip(0), worker_rlimit_nofile(0), shortest_first_writes(false), output_high_water(1048576), output_low_water(262144), worker_cpu_affinity() {}
 
 // ConfigParser
 ConfigParser::ConfigParser() : pos(0), line_num(1) {}
@@ -187,9 +211,21 @@ Config ConfigParser::parseConfig()
 			break;
 
 		if (token == "server")
+		{
 			config.servers.push_back(parseServer());
-		else
-			throwError("Expected 'server' directive, got: " + token);
+			continue;
+		}
+
+		std::string value = (token == "worker_cpu_affinity") ? getRestOfLine() : getNextToken();
+		if (value.empty())
+			throwError("Missing value for directive: " + token);
+
+		parseGlobalDirective(config, token, value);
+
+		skipWhitespace();
+		if (isAtEnd() || content[pos] != ';')
+			throwError("Expected ';' after directive: " + token);
+		pos++;
 	}
 
 	if (config.servers.empty())
@@ -230,7 +266,7 @@ ServerConfig ConfigParser::parseServer()
 		{
 			std::string value;
 			if (directive == "server_name" || directive == "error_page" ||
-				directive == "allow_methods" || directive == "index")
+				directive == "allow_methods" || directive == "index" || directive == "listen")
 				value = getRestOfLine();
 			else
 				value = getNextToken();
@@ -352,6 +388,210 @@ Location ConfigParser::parseLocation(const ServerConfig &server)
 	return location;
 }
 
+// 'auto' or a positive number, 'auto' is returned as 0
+int ConfigParser::parseWorkerCount(const std::string &directive, const std::string &value)
+{
+	if (value == "auto")
+		return 0;
+
+	for (size_t i = 0; i < value.length(); ++i)
+	{
+		if (!std::isdigit(value[i]))
+			throwError("Invalid '" + directive + "', expected 'auto' or a number: " + value);
+	}
+	int count = std::atoi(value.c_str());
+	if (count <= 0)
+		throwError("'" + directive + "' must be at least 1");
+	return count;
+}
+
+// Whole seconds, with an optional 's' suffix
+int ConfigParser::parseTimeout(const std::string &directive, const std::string &value)
+{
+	std::string number = value;
+	if (!number.empty() && number[number.length() - 1] == 's')
+		number.erase(number.length() - 1);
+
+	if (number.empty())
+		throwError("Invalid '" + directive + "', expected seconds: " + value);
+	for (size_t i = 0; i < number.length(); ++i)
+	{
+		if (!std::isdigit(number[i]))
+			throwError("Invalid '" + directive + "', expected seconds: " + value);
+	}
+	int seconds = std::atoi(number.c_str());
+	if (seconds <= 0)
+		throwError("'" + directive + "' must be at least 1 second");
+	return seconds;
+}
+
+// A positive count, or 'off' for no limit
+int ConfigParser::parseConnectionLimit(const std::string &directive, const std::string &value)
+{
+	if (value == "off")
+		return 0;
+	for (size_t i = 0; i < value.length(); ++i)
+	{
+		if (!std::isdigit(value[i]))
+			throwError("Invalid '" + directive + "', expected 'off' or a number: " + value);
+	}
+	int limit = std::atoi(value.c_str());
+	if (value.empty() || limit <= 0)
+		throwError("'" + directive + "' must be at least 1");
+	return limit;
+}
+
+// 'off', 'auto', or one mask of '0'/'1' per event loop, CPU 0 rightmost
+std::vector<std::string> ConfigParser::parseCpuAffinity(const std::string &value)
+{
+	std::vector<std::string> masks = split(value, ' ');
+	if (masks.size() == 1 && masks[0] == "off")
+		return std::vector<std::string>();
+	if (masks.size() == 1 && masks[0] == "auto")
+		return masks;
+
+	for (size_t i = 0; i < masks.size(); ++i)
+	{
+		if (masks[i].empty() || masks[i].length() > CPU_SETSIZE ||
+			masks[i].find_first_not_of("01") != std::string::npos)
+			throwError("Invalid 'worker_cpu_affinity', expected 'auto', 'off' or CPU bitmasks: " + masks[i]);
+		if (masks[i].find('1') == std::string::npos)
+			throwError("'worker_cpu_affinity' mask selects no CPU: " + masks[i]);
+	}
+	return masks;
+}
+
+void ConfigParser::parseGlobalDirective(Config &config, const std::string &directive, const std::string &value)
+{
+	if (directive == "event_backend")
+	{
+		if (!config.event_backend.empty())
+			throwError("Duplicate 'event_backend' directive");
+		if (value != "select" && value != "poll" && value != "epoll" && value != "io_uring")
+			throwError("Invalid 'event_backend', expected select, poll, epoll or io_uring: " + value);
+		config.event_backend = value;
+	}
+	else if (directive == "worker_processes")
+		config.worker_processes = parseWorkerCount(directive, value);
+	else if (directive == "worker_threads")
+		config.worker_threads = parseWorkerCount(directive, value);
+	else if (directive == "client_header_timeout")
+		config.timeouts.header = parseTimeout(directive, value);
+	else if (directive == "client_body_timeout")
+		config.timeouts.body = parseTimeout(directive, value);
+	else if (directive == "client_body_min_rate")
+		config.timeouts.body_min_rate = (value == "off") ? 0 : parseSize(value);
+	else if (directive == "keepalive_timeout")
+		config.timeouts.keepalive = parseTimeout(directive, value);
+	else if (directive == "keepalive_requests")
+		config.keepalive_requests = parseConnectionLimit(directive, value);
+	else if (directive == "send_timeout")
+		config.timeouts.send = parseTimeout(directive, value);
+	else if (directive == "shutdown_timeout")
+		config.shutdown_timeout = parseTimeout(directive, value);
+	else if (directive == "max_connections")
+		config.max_connections = parseConnectionLimit(directive, value);
+	else if (directive == "max_connections_per_ip")
+		config.max_connections_per_ip = parseConnectionLimit(directive, value);
+	else if (directive == "worker_rlimit_nofile")
+		config.worker_rlimit_nofile = parseWorkerCount(directive, value);
+	else if (directive == "write_scheduling")
+	{
+		if (value != "fifo" && value != "srpt")
+			throwError("Invalid 'write_scheduling', expected fifo or srpt: " + value);
+		config.shortest_first_writes = (value == "srpt");
+	}
+	else if (directive == "worker_cpu_affinity")
+		config.worker_cpu_affinity = parseCpuAffinity(value);
+	else if (directive == "output_water_marks")
+	{
+		std::vector<std::string> marks = split(value, ' ');
+		if (marks.size() == 1 && marks[0] == "off")
+			config.output_high_water = config.output_low_water = 0;
+		else if (marks.size() != 2)
+			throwError("Invalid 'output_water_marks', expected 'off' or high and low sizes: " + value);
+		else
+		{
+			config.output_high_water = parseSize(marks[0]);
+			config.output_low_water = parseSize(marks[1]);
+			if (config.output_low_water >= config.output_high_water)
+				throwError("'output_water_marks' low mark must be below the high mark: " + value);
+		}
+	}
+	else
+		throwError("Expected 'server' block or global directive, got: " + directive);
+}
+
+// listen [host:]port|unix:path [backlog=N] [deferred[=seconds]] [nodelay=on|off]
+//        [sndbuf=size] [rcvbuf=size] [fastopen=N] [notsent_lowat=size] [busy_poll=usec]
+void ConfigParser::parseListenDirective(ServerConfig &server, const std::string &value)
+{
+	std::vector<std::string> parts = split(value, ' ');
+	const std::string &address = parts[0];
+
+	size_t colon_pos = address.find(':');
+	if (address.compare(0, strlen(UnixSocket::PREFIX), UnixSocket::PREFIX) == 0)
+	{
+		// Routed by this host like a TCP listener by host and port
+		if (address.length() == strlen(UnixSocket::PREFIX) ||
+			address.length() - strlen(UnixSocket::PREFIX) >= sizeof(((struct sockaddr_un *)0)->sun_path))
+			throwError("Invalid Unix socket path in 'listen': " + address);
+		server.host = address;
+		server.port = 0;
+	}
+	else if (colon_pos != std::string::npos)
+	{
+		server.host = address.substr(0, colon_pos);
+		server.port = std::atoi(address.substr(colon_pos + 1).c_str());
+	}
+	else
+		server.port = std::atoi(address.c_str());
+
+	for (size_t i = 1; i < parts.size(); ++i)
+	{
+		const std::string &param = parts[i];
+		if (param.compare(0, 8, "backlog=") == 0)
+		{
+			server.listen_backlog = std::atoi(param.substr(8).c_str());
+			if (server.listen_backlog <= 0)
+				throwError("Invalid listen backlog: " + param);
+		}
+		else if (param == "deferred")
+			server.defer_accept = 1;
+		else if (param.compare(0, 9, "deferred=") == 0)
+		{
+			server.defer_accept = std::atoi(param.substr(9).c_str());
+			if (server.defer_accept <= 0)
+				throwError("Invalid deferred timeout: " + param);
+		}
+		else if (param == "nodelay=on" || param == "nodelay=off")
+			server.tcp_nodelay = (param == "nodelay=on");
+		else if (param.compare(0, 7, "sndbuf=") == 0)
+			server.sndbuf = parseSocketSize(param.substr(7));
+		else if (param.compare(0, 7, "rcvbuf=") == 0)
+			server.rcvbuf = parseSocketSize(param.substr(7));
+		else if (param.compare(0, 14, "notsent_lowat=") == 0)
+			server.notsent_lowat = parseSocketSize(param.substr(14));
+		else if (param.compare(0, 9, "fastopen=") == 0)
+		{
+			server.fastopen = std::atoi(param.substr(9).c_str());
+			if (server.fastopen <= 0)
+				throwError("Invalid fastopen queue length: " + param);
+		}
+		else if (param.compare(0, 10, "busy_poll=") == 0)
+		{
+			server.busy_poll = std::atoi(param.substr(10).c_str());
+			if (server.busy_poll <= 0)
+				throwError("Invalid busy_poll time: " + param);
+		}
+		else
+			throwError("Unknown listen parameter: " + param);
+	}
+	if (server.isUnixSocket() &&
+		(server.defer_accept > 0 || server.fastopen > 0 || server.notsent_lowat > 0 || server.busy_poll > 0))
+		throwError("'deferred', 'fastopen', 'notsent_lowat' and 'busy_poll' need a TCP listener: " + value);
+}
+
 void ConfigParser::parseServerDirective(ServerConfig &server, const std::string &directive, const std::string &value, ServerParseState &state)
 {
 	if (directive == "listen")
@@ -359,14 +599,7 @@ void ConfigParser::parseServerDirective(ServerConfig &server, const std::string
 		if (state.listen_found)
 			throwError("Duplicate 'listen' directive");
 		state.listen_found = true;
-		size_t colon_pos = value.find(':');
-		if (colon_pos != std::string::npos)
-		{
-			server.host = value.substr(0, colon_pos);
-			server.port = std::atoi(value.substr(colon_pos + 1).c_str());
-		}
-		else
-			server.port = std::atoi(value.c_str());
+		parseListenDirective(server, value);
 	}
 	else if (directive == "server_name")
 	{
@@ -395,6 +628,13 @@ void ConfigParser::parseServerDirective(ServerConfig &server, const std::string
 		state.client_max_body_size_found = true;
 		server.client_max_body_size = parseSize(value);
 	}
+	else if (directive == "max_connections")
+	{
+		if (state.max_connections_found)
+			throwError("Duplicate 'max_connections' directive");
+		state.max_connections_found = true;
+		server.max_connections = parseConnectionLimit(directive, value);
+	}
 	else if (directive == "root")
 	{
 		if (state.root_found)
@@ -557,6 +797,15 @@ bool ConfigParser::isValidPort(int port) const
 	return port > 0 && port <= 65535;
 }
 
+// A socket option value, which setsockopt() takes as an int
+int ConfigParser::parseSocketSize(const std::string &sizeStr) const
+{
+	size_t size = parseSize(sizeStr);
+	if (size > static_cast<size_t>(INT_MAX))
+		throwError("Size too large for a socket option: " + sizeStr);
+	return static_cast<int>(size);
+}
+
 size_t ConfigParser::parseSize(const std::string &sizeStr) const
 {
 	if (sizeStr.empty())
@@ -615,7 +864,7 @@ void ConfigParser::validateConfig(const Config &config) const
 
 void ConfigParser::validateServer(const ServerConfig &server) const
 {
-	if (!isValidPort(server.port))
+	if (!server.isUnixSocket() && !isValidPort(server.port))
 		throwError("Invalid port number");
 
 	for (size_t i = 0; i < server.locations.size(); ++i)
@@ -652,13 +901,61 @@ void ConfigParser::validateLocation(const Location &location) const
 void ConfigParser::printConfig(const Config &config) const
 {
 	std::cout << "=== Configuration ===\n";
+	if (!config.event_backend.empty())
+		std::cout << "Event Backend: " << config.event_backend << "\n";
+	if (config.worker_processes == 0)
+		std::cout << "Worker Processes: auto\n";
+	else if (config.worker_processes > 1)
+		std::cout << "Worker Processes: " << config.worker_processes << "\n";
+	if (config.worker_threads == 0)
+		std::cout << "Worker Threads: auto\n";
+	else if (config.worker_threads > 1)
+		std::cout << "Worker Threads: " << config.worker_threads << "\n";
+	if (config.worker_rlimit_nofile > 0)
+		std::cout << "Fd Limit: " << config.worker_rlimit_nofile << "\n";
+	if (config.shortest_first_writes)
+		std::cout << "Write Scheduling: shortest remaining first\n";
+	if (config.output_high_water > 0)
+		std::cout << "Output Water Marks: " << config.output_high_water << " high, "
+				  << config.output_low_water << " low bytes\n";
+	if (!config.worker_cpu_affinity.empty())
+	{
+		std::cout << "CPU Affinity:";
+		for (size_t i = 0; i < config.worker_cpu_affinity.size(); ++i)
+			std::cout << " " << config.worker_cpu_affinity[i];
+		std::cout << "\n";
+	}
+	std::cout << "Timeouts: header " << config.timeouts.header
+			  << "s, body " << config.timeouts.body << "s at " << config.timeouts.body_min_rate
+			  << " B/s, keepalive " << config.timeouts.keepalive
+			  << "s, send " << config.timeouts.send
+			  << "s, shutdown " << config.shutdown_timeout << "s\n";
+	std::cout << "Keep-Alive Requests: " << config.keepalive_requests << " per connection (0 = unlimited)\n";
+	if (config.max_connections > 0 || config.max_connections_per_ip > 0)
+		std::cout << "Connection Limits: " << config.max_connections << " total, "
+				  << config.max_connections_per_ip << " per IP (0 = unlimited)\n";
 	for (size_t i = 0; i < config.servers.size(); ++i)
 	{
 		const ServerConfig &server = config.servers[i];
 		std::cout << "\nServer " << (i + 1) << ":\n";
 		std::cout << "  Host: " << server.host << "\n";
 		std::cout << "  Port: " << server.port << "\n";
+		std::cout << "  Listen Backlog: " << server.listen_backlog << "\n";
+		if (server.defer_accept > 0)
+			std::cout << "  Deferred Accept: " << server.defer_accept << "s\n";
+		if (!server.tcp_nodelay)
+			std::cout << "  TCP_NODELAY: off\n";
+		if (server.sndbuf > 0 || server.rcvbuf > 0)
+			std::cout << "  Socket Buffers: " << server.sndbuf << " send, " << server.rcvbuf << " receive (0 = default)\n";
+		if (server.fastopen > 0)
+			std::cout << "  Fast Open Queue: " << server.fastopen << "\n";
+		if (server.notsent_lowat > 0)
+			std::cout << "  Not-Sent Low Water Mark: " << server.notsent_lowat << " bytes\n";
+		if (server.busy_poll > 0)
+			std::cout << "  Busy Poll: " << server.busy_poll << "us\n";
 		std::cout << "  Max Body Size: " << server.client_max_body_size << " bytes\n";
+		if (server.max_connections > 0)
+			std::cout << "  Max Connections: " << server.max_connections << "\n";
 		if (!server.server_names.empty())
 		{
 			std::cout << "  Server Names: ";
@@ -0,0 +1,131 @@
+#include <ConfigStore.hpp>
+#include <iostream>
+#include <stdexcept>
+#include <set>
+
+ConfigStore::ConfigStore(const std::string &path) : _path(path), _current(NULL), _generation(1), _unixListenersFixed(false)
+{
+	Snapshot *snapshot = new Snapshot();
+	try
+	{
+		snapshot->config.loadConfig(path);
+	}
+	catch (...)
+	{
+		delete snapshot;
+		throw;
+	}
+	snapshot->generation = this->_generation;
+	snapshot->refCount = 1; // The store's own reference
+	this->_current = snapshot;
+	pthread_mutex_init(&this->_mutex, NULL);
+}
+
+ConfigStore::~ConfigStore()
+{
+	this->unref(this->_current);
+	pthread_mutex_destroy(&this->_mutex);
+}
+
+void ConfigStore::setUnixListenersFixed(bool fixed) { this->_unixListenersFixed = fixed; }
+
+static std::set<std::string> getUnixPaths(const ConfigManager &config)
+{
+	std::set<std::string> paths;
+	const std::vector<ServerConfig> &servers = config.getServers();
+	for (size_t i = 0; i < servers.size(); ++i)
+	{
+		if (servers[i].isUnixSocket())
+			paths.insert(servers[i].getUnixPath());
+	}
+	return paths;
+}
+
+bool ConfigStore::reload()
+{
+	// Parse outside the lock, the running snapshot stays in use meanwhile
+	Snapshot *snapshot = new Snapshot();
+	try
+	{
+		snapshot->config.loadConfig(this->_path);
+	}
+	catch (const std::exception &e)
+	{
+		std::cerr << "Error: Reload of " << this->_path << " failed, keeping the current configuration: " << e.what() << std::endl;
+		delete snapshot;
+		return false;
+	}
+	snapshot->refCount = 1;
+
+	if (this->_unixListenersFixed)
+	{
+		Snapshot *current = this->acquire();
+		bool changed = getUnixPaths(current->config) != getUnixPaths(snapshot->config);
+		this->release(current);
+		if (changed)
+		{
+			std::cerr << "Error: Reload of " << this->_path << " refused, keeping the current configuration: "
+					  << "with worker_processes, Unix socket listeners only change on restart" << std::endl;
+			delete snapshot;
+			return false;
+		}
+	}
+
+	pthread_mutex_lock(&this->_mutex);
+	Snapshot *previous = this->_current;
+	snapshot->generation = previous->generation + 1;
+	this->_current = snapshot;
+	__atomic_store_n(&this->_generation, snapshot->generation, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&this->_mutex);
+
+	// Settings fixed at start-up are not re-applied
+	const ConfigManager &before = previous->config;
+	const ConfigManager &after = snapshot->config;
+	if (before.getEventBackend() != after.getEventBackend() ||
+		before.getWorkerProcesses() != after.getWorkerProcesses() ||
+		before.getWorkerThreads() != after.getWorkerThreads())
+		std::cerr << "Warning: event_backend, worker_processes and worker_threads only change on restart" << std::endl;
+
+	this->unref(previous);
+	std::cout << "Configuration reloaded from " << this->_path << " (generation " << snapshot->generation << ")" << std::endl;
+	return true;
+}
+
+ConfigStore::Snapshot *ConfigStore::acquire()
+{
+	pthread_mutex_lock(&this->_mutex);
+	Snapshot *snapshot = this->_current;
+	snapshot->refCount++;
+	pthread_mutex_unlock(&this->_mutex);
+	return snapshot;
+}
+
+ConfigStore::Snapshot *ConfigStore::retain(Snapshot *snapshot)
+{
+	pthread_mutex_lock(&this->_mutex);
+	snapshot->refCount++;
+	pthread_mutex_unlock(&this->_mutex);
+	return snapshot;
+}
+
+void ConfigStore::release(Snapshot *snapshot)
+{
+	this->unref(snapshot);
+}
+
+void ConfigStore::unref(Snapshot *snapshot)
+{
+	if (!snapshot)
+		return;
+
+	pthread_mutex_lock(&this->_mutex);
+	bool last = (--snapshot->refCount == 0);
+	pthread_mutex_unlock(&this->_mutex);
+	if (last)
+		delete snapshot;
+}
+
+unsigned long ConfigStore::getGeneration() const
+{
+	return __atomic_load_n(&this->_generation, __ATOMIC_ACQUIRE);
+}
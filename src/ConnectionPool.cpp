@@ -0,0 +1,56 @@
+#include <ConnectionPool.hpp>
+#include <ClientConnection.hpp>
+
+const size_t ConnectionPool::_BLOCK_SIZE = 256;
+const size_t ConnectionPool::_MAX_IDLE_BUFFER = 64 * 1024;
+
+ConnectionPool::ConnectionPool() : _capacity(0)
+{
+	this->grow();
+}
+
+ConnectionPool::~ConnectionPool()
+{
+	for (size_t i = 0; i < this->_blocks.size(); ++i)
+		delete[] this->_blocks[i];
+}
+
+void ConnectionPool::grow()
+{
+	ClientConnection *block = new ClientConnection[_BLOCK_SIZE];
+	this->_blocks.push_back(block);
+	this->_capacity += _BLOCK_SIZE;
+
+	// Hand out the block front to back
+	this->_free.reserve(this->_capacity);
+	for (size_t i = _BLOCK_SIZE; i > 0; --i)
+		this->_free.push_back(&block[i - 1]);
+}
+
+ClientConnection *ConnectionPool::acquire(int fd)
+{
+	if (this->_free.empty())
+		this->grow();
+
+	ClientConnection *client = this->_free.back();
+	this->_free.pop_back();
+	client->reset(fd);
+	return client;
+}
+
+void ConnectionPool::release(ClientConnection *client)
+{
+	client->close();
+	client->shrinkBuffers(_MAX_IDLE_BUFFER);
+	this->_free.push_back(client);
+}
+
+size_t ConnectionPool::getCapacity() const
+{
+	return this->_capacity;
+}
+
+size_t ConnectionPool::getInUse() const
+{
+	return this->_capacity - this->_free.size();
+}
@@ -0,0 +1,86 @@
+#include <CpuAffinity.hpp>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+
+namespace CpuAffinity
+{
+	static bool getAutoCpus(int slot, cpu_set_t &cpus)
+	{
+		cpu_set_t allowed;
+		CPU_ZERO(&allowed);
+		if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0)
+			return false;
+
+		int index = slot % CPU_COUNT(&allowed);
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+		{
+			if (!CPU_ISSET(cpu, &allowed))
+				continue;
+			if (index-- == 0)
+			{
+				CPU_SET(cpu, &cpus);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool getSlotCpus(const std::vector<std::string> &affinity, int slot, cpu_set_t &cpus)
+	{
+		CPU_ZERO(&cpus);
+		if (affinity.empty())
+			return false;
+		if (affinity[0] == "auto")
+			return getAutoCpus(slot, cpus);
+
+		const std::string &mask = affinity[std::min(static_cast<size_t>(slot), affinity.size() - 1)];
+		for (size_t i = 0; i < mask.length(); ++i)
+		{
+			if (mask[mask.length() - 1 - i] == '1')
+				CPU_SET(i, &cpus);
+		}
+		return true;
+	}
+
+	int getSlotCpu(const std::vector<std::string> &affinity, int slot)
+	{
+		cpu_set_t cpus;
+		if (!getSlotCpus(affinity, slot, cpus) || CPU_COUNT(&cpus) != 1)
+			return -1;
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+		{
+			if (CPU_ISSET(cpu, &cpus))
+				return cpu;
+		}
+		return -1;
+	}
+
+	bool pinCurrentThread(const std::vector<std::string> &affinity, int slot)
+	{
+		cpu_set_t cpus;
+		if (!getSlotCpus(affinity, slot, cpus))
+			return false;
+		if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+		{
+			std::cerr << "Error: Cannot pin event loop " << slot << " to its CPUs: " << strerror(errno) << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	int getIncomingCpu(int fd)
+	{
+#ifdef SO_INCOMING_CPU
+		int cpu = -1;
+		socklen_t length = sizeof(cpu);
+		if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &length) == 0)
+			return cpu;
+#else
+		(void)fd;
+#endif
+		return -1;
+	}
+}
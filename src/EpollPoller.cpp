@@ -0,0 +1,82 @@
+#include <EpollPoller.hpp>
+
+#ifdef __linux__
+
+#include <unistd.h>
+#include <cstring>
+
+const int EpollPoller::_MAX_EVENTS = 1024;
+
+EpollPoller::EpollPoller() : _epollFd(epoll_create(_MAX_EVENTS))
+{
+	this->_epollEvents.resize(_MAX_EVENTS);
+}
+
+EpollPoller::~EpollPoller()
+{
+	if (this->_epollFd != -1)
+		close(this->_epollFd);
+}
+
+bool EpollPoller::isValid() const
+{
+	return this->_epollFd != -1;
+}
+
+bool EpollPoller::control(int op, int fd, unsigned int events)
+{
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	if (events & POLLER_READ)
+		ev.events |= EPOLLIN;
+	if (events & POLLER_WRITE)
+		ev.events |= EPOLLOUT;
+	ev.data.fd = fd;
+	return epoll_ctl(this->_epollFd, op, fd, &ev) == 0;
+}
+
+bool EpollPoller::add(int fd, unsigned int events)
+{
+	return this->control(EPOLL_CTL_ADD, fd, events);
+}
+
+bool EpollPoller::modify(int fd, unsigned int events)
+{
+	return this->control(EPOLL_CTL_MOD, fd, events);
+}
+
+void EpollPoller::remove(int fd)
+{
+	epoll_ctl(this->_epollFd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int EpollPoller::wait(std::vector<PollEvent> &events, int timeoutMs)
+{
+	events.clear();
+
+	int activity = epoll_wait(this->_epollFd, &this->_epollEvents[0], this->_epollEvents.size(), timeoutMs);
+	if (activity <= 0)
+		return activity;
+
+	for (int i = 0; i < activity; ++i)
+	{
+		PollEvent event;
+		event.fd = this->_epollEvents[i].data.fd;
+		event.events = 0;
+		if (this->_epollEvents[i].events & EPOLLIN)
+			event.events |= POLLER_READ;
+		if (this->_epollEvents[i].events & EPOLLOUT)
+			event.events |= POLLER_WRITE;
+		if (this->_epollEvents[i].events & (EPOLLERR | EPOLLHUP))
+			event.events |= POLLER_ERROR;
+		events.push_back(event);
+	}
+	return activity;
+}
+
+const char *EpollPoller::getName() const
+{
+	return "epoll";
+}
+
+#endif
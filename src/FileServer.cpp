@@ -4,8 +4,10 @@
 #include <algorithm>
 #include <string>
 #include <unistd.h>
+#include <pthread.h>
 
 std::map<std::string, std::string> FileServer::mimeTypes;
+static pthread_once_t mimeTypesOnce = PTHREAD_ONCE_INIT;
 
 FileServer::FileServer() {}
 FileServer::~FileServer() {}
@@ -174,11 +176,9 @@ bool FileServer::deleteFile(const std::string &filePath)
 	return true; // File deleted successfully
 }
 
+// Runs exactly once through pthread_once(), event-loop threads only read the map afterwards
 void FileServer::initMimeTypes()
 {
-	if (!mimeTypes.empty())
-		return;
-
 	mimeTypes[".html"] = "text/html";
 	mimeTypes[".htm"] = "text/html";
 	mimeTypes[".css"] = "text/css";
@@ -209,20 +209,20 @@ void FileServer::initMimeTypes()
 
 std::string FileServer::getMimeType(const std::string &filePath)
 {
-	if (mimeTypes.empty())
-		initMimeTypes();
+	pthread_once(&mimeTypesOnce, initMimeTypes);
 
+	// Only const lookups here: operator[] could insert and race with other threads
+	std::map<std::string, std::string>::const_iterator it = mimeTypes.end();
 	size_t dotPos = filePath.rfind('.');
-	if (dotPos == std::string::npos)
-		return mimeTypes["default"];
-
-	std::string extension = filePath.substr(dotPos);
-	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
-
-	std::map<std::string, std::string>::const_iterator it = mimeTypes.find(extension);
-	if (it != mimeTypes.end())
-		return it->second;
-	return mimeTypes["default"];
+	if (dotPos != std::string::npos)
+	{
+		std::string extension = filePath.substr(dotPos);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		it = mimeTypes.find(extension);
+	}
+	if (it == mimeTypes.end())
+		it = mimeTypes.find("default");
+	return it->second;
 }
 
 std::string FileServer::generateDirectoryListing(const std::string &directoryPath, const std::string &requestPath)
@@ -0,0 +1,82 @@
+#include <HandoffQueue.hpp>
+#include <unistd.h>
+#include <fcntl.h>
+
+const size_t HandoffQueue::_CAPACITY;
+
+HandoffQueue::HandoffQueue() : _head(0), _tail(0)
+{
+	this->_wakeFds[0] = -1;
+	this->_wakeFds[1] = -1;
+	if (pipe(this->_wakeFds) == -1)
+		return;
+	for (int i = 0; i < 2; ++i)
+	{
+		fcntl(this->_wakeFds[i], F_SETFL, fcntl(this->_wakeFds[i], F_GETFL, 0) | O_NONBLOCK);
+		fcntl(this->_wakeFds[i], F_SETFD, FD_CLOEXEC);
+	}
+}
+
+HandoffQueue::~HandoffQueue()
+{
+	// Connections that were never picked up are closed here
+	Item item;
+	while (this->pop(item))
+	{
+		if (item.fd >= 0)
+			close(item.fd);
+	}
+	if (this->_wakeFds[0] != -1)
+		close(this->_wakeFds[0]);
+	if (this->_wakeFds[1] != -1)
+		close(this->_wakeFds[1]);
+}
+
+bool HandoffQueue::isValid() const
+{
+	return this->_wakeFds[0] != -1;
+}
+
+bool HandoffQueue::push(const Item &item)
+{
+	size_t tail = this->_tail;
+	size_t head = __atomic_load_n(&this->_head, __ATOMIC_ACQUIRE);
+	if (tail - head >= _CAPACITY)
+		return false; // Full, the loop is not keeping up
+
+	this->_items[tail & (_CAPACITY - 1)] = item;
+	__atomic_store_n(&this->_tail, tail + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+void HandoffQueue::notify()
+{
+	// A full pipe already guarantees a pending wakeup, EAGAIN is fine
+	char byte = 0;
+	ssize_t ret = write(this->_wakeFds[1], &byte, 1);
+	(void)ret;
+}
+
+bool HandoffQueue::pop(Item &item)
+{
+	size_t head = this->_head;
+	size_t tail = __atomic_load_n(&this->_tail, __ATOMIC_ACQUIRE);
+	if (head == tail)
+		return false;
+
+	item = this->_items[head & (_CAPACITY - 1)];
+	__atomic_store_n(&this->_head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+int HandoffQueue::getWakeFd() const
+{
+	return this->_wakeFds[0];
+}
+
+void HandoffQueue::drainWakeFd()
+{
+	char buffer[256];
+	while (read(this->_wakeFds[0], buffer, sizeof(buffer)) > 0)
+		;
+}
@@ -0,0 +1,53 @@
+#include <IdleList.hpp>
+
+IdleList::Node::Node() : prev(NULL), next(NULL), fd(-1) {}
+
+bool IdleList::Node::isLinked() const
+{
+	return this->next != NULL;
+}
+
+IdleList::IdleList() : _count(0)
+{
+	this->_head.prev = &this->_head;
+	this->_head.next = &this->_head;
+}
+
+// Leave the owners' nodes in a consistent, unlinked state
+IdleList::~IdleList()
+{
+	while (this->_head.next != &this->_head)
+		this->remove(*this->_head.next);
+}
+
+void IdleList::pushBack(Node &node)
+{
+	if (node.isLinked())
+		this->remove(node);
+	node.prev = this->_head.prev;
+	node.next = &this->_head;
+	this->_head.prev->next = &node;
+	this->_head.prev = &node;
+	this->_count++;
+}
+
+void IdleList::remove(Node &node)
+{
+	if (!node.isLinked())
+		return;
+	node.prev->next = node.next;
+	node.next->prev = node.prev;
+	node.prev = NULL;
+	node.next = NULL;
+	this->_count--;
+}
+
+int IdleList::front() const
+{
+	return this->_head.next == &this->_head ? -1 : this->_head.next->fd;
+}
+
+size_t IdleList::size() const
+{
+	return this->_count;
+}
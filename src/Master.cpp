@@ -0,0 +1,367 @@
+#include <Master.hpp>
+#include <ConfigStore.hpp>
+#include <Server.hpp>
+#include <Reactor.hpp>
+#include <Upgrade.hpp>
+#include <CpuAffinity.hpp>
+#include <UnixSocket.hpp>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+const int Master::_RESPAWN_THROTTLE_SECONDS = 1;
+volatile sig_atomic_t Master::_stopRequested = 0;
+volatile sig_atomic_t Master::_reloadRequested = 0;
+volatile sig_atomic_t Master::_upgradeRequested = 0;
+
+Master::Master(ConfigStore &configStore) : _configStore(configStore), _upgradePid(-1)
+{
+	this->_readyPipe[0] = -1;
+	this->_readyPipe[1] = -1;
+}
+
+Master::~Master()
+{
+	this->closeReadyPipe();
+}
+
+void Master::setEventBackend(const std::string &backend) { this->_eventBackend = backend; }
+void Master::setInheritedListeners(const std::vector<int> &listenFds) { this->_inheritedListeners = listenFds; }
+
+void Master::signalHandler(int signal)
+{
+	if (signal == SIGINT || signal == SIGTERM)
+		_stopRequested = signal;
+	else if (signal == SIGHUP)
+		_reloadRequested = 1;
+	else if (signal == SIGUSR2)
+		_upgradeRequested = 1;
+}
+
+void Master::installSignalHandlers()
+{
+	// No SA_RESTART: waitpid() must return EINTR so the stop flag is seen
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = signalHandler;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = 0;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGHUP, &sa, NULL);
+	sigaction(SIGUSR2, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+}
+
+int Master::run(int workerCount)
+{
+	this->installSignalHandlers();
+	if (!this->openUnixListeners())
+		return 1;
+	this->_configStore.setUnixListenersFixed(true);
+	if (pipe(this->_readyPipe) == -1)
+	{
+		logError("pipe() failed: " + std::string(strerror(errno)));
+		return 1;
+	}
+	fcntl(this->_readyPipe[0], F_SETFD, FD_CLOEXEC);
+	fcntl(this->_readyPipe[1], F_SETFD, FD_CLOEXEC);
+
+	this->_workers.resize(workerCount);
+	for (size_t slot = 0; slot < this->_workers.size(); ++slot)
+	{
+		this->_workers[slot].pid = -1;
+		if (!this->spawnWorker(slot))
+		{
+			this->closeReadyPipe();
+			this->stopWorkers();
+			return 1;
+		}
+	}
+	// An old binary must keep serving until every new worker has bound
+	if (!this->waitForWorkers())
+	{
+		if (!_stopRequested)
+			logError("A worker exited during start-up, shutting down");
+		this->stopWorkers();
+		return _stopRequested ? 0 : 1;
+	}
+	std::cout << "Master " << getpid() << " started " << workerCount << " worker(s)" << std::endl;
+	Upgrade::notifyReady();
+
+	int exitStatus = 0;
+	while (!_stopRequested && this->getAliveWorkerCount() > 0)
+	{
+		int status;
+		pid_t pid = waitpid(-1, &status, 0);
+		if (pid < 0)
+		{
+			if (errno == EINTR)
+			{
+				if (_reloadRequested)
+					this->reloadWorkers();
+				if (_upgradeRequested)
+					this->startUpgrade();
+				continue;
+			}
+			logError("waitpid() failed: " + std::string(strerror(errno)));
+			break;
+		}
+		if (!this->reapWorker(pid, status))
+		{
+			exitStatus = 1;
+			break;
+		}
+	}
+
+	this->stopWorkers();
+	return exitStatus;
+}
+
+// Added to the inherited listeners, which workers adopt by address and an
+// upgraded binary receives as well. Those already inherited are kept as is.
+bool Master::openUnixListeners()
+{
+	ConfigStore::Snapshot *snapshot = this->_configStore.acquire();
+	const std::vector<ServerConfig> &servers = snapshot->config.getServers();
+	bool ok = true;
+
+	for (size_t i = 0; i < servers.size() && ok; ++i)
+	{
+		if (!servers[i].isUnixSocket())
+			continue;
+
+		std::string path = servers[i].getUnixPath();
+		bool inherited = false;
+		for (size_t j = 0; j < this->_inheritedListeners.size() && !inherited; ++j)
+			inherited = (UnixSocket::getBoundPath(this->_inheritedListeners[j]) == path);
+		if (inherited)
+			continue;
+
+		int listenFd = UnixSocket::listen(path, servers[i].listen_backlog);
+		if (listenFd < 0)
+		{
+			logError("Failed to listen on " + servers[i].host + ": " + strerror(errno));
+			ok = false;
+			continue;
+		}
+		this->_inheritedListeners.push_back(listenFd);
+	}
+	this->_configStore.release(snapshot);
+	return ok;
+}
+
+// Each worker writes one byte once initialized. A worker that exits first
+// closes its end without writing, so EOF ends the wait early.
+bool Master::waitForWorkers()
+{
+	close(this->_readyPipe[1]);
+	this->_readyPipe[1] = -1;
+
+	size_t ready = 0;
+	char byte;
+	while (ready < this->_workers.size())
+	{
+		ssize_t n = read(this->_readyPipe[0], &byte, 1);
+		if (n > 0)
+			ready++;
+		else if (n < 0 && errno == EINTR && !_stopRequested)
+			continue;
+		else
+			break;
+	}
+	this->closeReadyPipe();
+	return ready == this->_workers.size();
+}
+
+void Master::closeReadyPipe()
+{
+	for (int i = 0; i < 2; ++i)
+	{
+		if (this->_readyPipe[i] >= 0)
+			close(this->_readyPipe[i]);
+		this->_readyPipe[i] = -1;
+	}
+}
+
+bool Master::spawnWorker(size_t slot)
+{
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		logError("fork() failed: " + std::string(strerror(errno)));
+		return false;
+	}
+	if (pid == 0)
+	{
+		// Worker: drop the master's handlers, the Server installs its own
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+		signal(SIGHUP, SIG_IGN); // Starts from the newest snapshot anyway
+		signal(SIGUSR2, SIG_IGN);
+		if (this->_readyPipe[0] >= 0)
+			close(this->_readyPipe[0]);
+		std::exit(this->runWorker(slot));
+	}
+
+	this->_workers[slot].pid = pid;
+	this->_workers[slot].startedAt = time(NULL);
+	std::cout << "Worker " << slot << " started with pid " << pid << std::endl;
+	return true;
+}
+
+int Master::runWorker(size_t slot)
+{
+	int readyFd = this->_readyPipe[1]; // -1 for a respawned worker
+	this->_readyPipe[1] = -1;
+	ConfigStore::Snapshot *snapshot = this->_configStore.acquire();
+	int threadCount = snapshot->config.getWorkerThreads();
+	std::vector<std::string> affinity = snapshot->config.getWorkerCpuAffinity();
+	this->_configStore.release(snapshot);
+	if (threadCount > 1)
+	{
+		// The loop threads are pinned, the acceptor keeps the worker's CPUs
+		Reactor reactor(this->_configStore);
+		reactor.setReusePort(true);
+		reactor.setCpuAffinity(affinity, slot * threadCount);
+		reactor.setInheritedListeners(this->_inheritedListeners);
+		reactor.setReadyFd(readyFd);
+		if (!this->_eventBackend.empty())
+			reactor.setEventBackend(this->_eventBackend);
+		return reactor.run(threadCount);
+	}
+
+	// Pinned before the Server allocates anything, see CpuAffinity.hpp
+	CpuAffinity::pinCurrentThread(affinity, slot);
+	Server server(this->_configStore);
+	server.setReusePort(true);
+	server.setIncomingCpu(CpuAffinity::getSlotCpu(affinity, slot));
+	server.setInheritedListeners(this->_inheritedListeners);
+	if (!this->_eventBackend.empty())
+		server.setEventBackend(this->_eventBackend);
+	if (!server.initialize())
+		return 1;
+	Upgrade::reportReady(readyFd);
+	server.run();
+	return 0;
+}
+
+// Returns false when the worker failed in a way respawning cannot fix
+bool Master::reapWorker(pid_t pid, int status)
+{
+	if (pid == this->_upgradePid)
+	{
+		std::cerr << "Error: Upgrade: new binary " << pid << " exited before taking over, still serving" << std::endl;
+		this->_upgradePid = -1;
+		return true;
+	}
+
+	int slot = this->findWorkerSlot(pid);
+	if (slot < 0)
+		return true; // Already removed from its slot, nothing to replace
+
+	Worker &worker = this->_workers[slot];
+	worker.pid = -1;
+
+	if (WIFEXITED(status) && WEXITSTATUS(status) != 0)
+	{
+		std::cerr << "Error: Worker " << slot << " (pid " << pid << ") exited with status "
+				  << WEXITSTATUS(status) << ", shutting down" << std::endl;
+		return false;
+	}
+	// A worker stopped along with the master (e.g. SIGINT to the process
+	// group) is not replaced, one stopped on its own is
+	if (_stopRequested)
+		return true;
+
+	if (WIFSIGNALED(status))
+		std::cerr << "Worker " << slot << " (pid " << pid << ") killed by signal " << WTERMSIG(status) << ", respawning" << std::endl;
+	else
+		std::cerr << "Worker " << slot << " (pid " << pid << ") exited, respawning" << std::endl;
+
+	// Avoid a fork loop when a worker crashes right after start-up
+	if (time(NULL) - worker.startedAt < _RESPAWN_THROTTLE_SECONDS)
+		sleep(_RESPAWN_THROTTLE_SECONDS);
+	if (_stopRequested)
+		return true;
+	return this->spawnWorker(slot);
+}
+
+void Master::stopWorkers()
+{
+	// Draining workers exit on their own within their shutdown timeout
+	int stopSignal = (_stopRequested == SIGINT) ? SIGINT : SIGTERM;
+	for (size_t slot = 0; slot < this->_workers.size(); ++slot)
+	{
+		if (this->_workers[slot].pid > 0)
+			kill(this->_workers[slot].pid, stopSignal);
+	}
+	for (size_t slot = 0; slot < this->_workers.size(); ++slot)
+	{
+		if (this->_workers[slot].pid > 0)
+		{
+			while (waitpid(this->_workers[slot].pid, NULL, 0) < 0 && errno == EINTR)
+				;
+			this->_workers[slot].pid = -1;
+		}
+	}
+}
+
+// Workers re-read the file themselves; the master validates it first so a
+// broken file is reported once, and keeps it for workers it respawns later
+void Master::reloadWorkers()
+{
+	_reloadRequested = 0;
+	if (!this->_configStore.reload())
+		return;
+	for (size_t slot = 0; slot < this->_workers.size(); ++slot)
+	{
+		if (this->_workers[slot].pid > 0)
+			kill(this->_workers[slot].pid, SIGHUP);
+	}
+}
+
+int Master::findWorkerSlot(pid_t pid) const
+{
+	for (size_t slot = 0; slot < this->_workers.size(); ++slot)
+	{
+		if (this->_workers[slot].pid == pid)
+			return slot;
+	}
+	return -1;
+}
+
+size_t Master::getAliveWorkerCount() const
+{
+	size_t alive = 0;
+	for (size_t slot = 0; slot < this->_workers.size(); ++slot)
+	{
+		if (this->_workers[slot].pid > 0)
+			alive++;
+	}
+	return alive;
+}
+
+void Master::logError(const std::string &message) const
+{
+	std::cerr << "Error: " << message << std::endl;
+}
+
+// Workers bind their own SO_REUSEPORT listeners, so the new binary only
+// needs the socket-activated ones: its workers bind next to ours before it
+// asks us to drain
+void Master::startUpgrade()
+{
+	_upgradeRequested = 0;
+	if (this->_upgradePid > 0)
+		return;
+	this->_upgradePid = Upgrade::spawn(this->_inheritedListeners);
+	if (this->_upgradePid < 0)
+		logError("Upgrade: cannot start the new binary: " + std::string(strerror(errno)));
+	else
+		std::cout << "Upgrade: started new binary with pid " << this->_upgradePid << std::endl;
+}
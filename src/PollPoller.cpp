@@ -0,0 +1,97 @@
+#include <PollPoller.hpp>
+#include <cerrno>
+
+PollPoller::PollPoller() {}
+
+PollPoller::~PollPoller() {}
+
+short PollPoller::toPollEvents(unsigned int events)
+{
+	short pollEvents = 0;
+	if (events & POLLER_READ)
+		pollEvents |= POLLIN;
+	if (events & POLLER_WRITE)
+		pollEvents |= POLLOUT;
+	return pollEvents;
+}
+
+bool PollPoller::add(int fd, unsigned int events)
+{
+	if (fd < 0)
+	{
+		errno = EBADF;
+		return false;
+	}
+	if (static_cast<size_t>(fd) >= this->_indexByFd.size())
+		this->_indexByFd.resize(fd + 1, -1);
+	if (this->_indexByFd[fd] != -1)
+		return this->modify(fd, events);
+
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = toPollEvents(events);
+	pfd.revents = 0;
+	this->_indexByFd[fd] = this->_pollFds.size();
+	this->_pollFds.push_back(pfd);
+	return true;
+}
+
+bool PollPoller::modify(int fd, unsigned int events)
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= this->_indexByFd.size() || this->_indexByFd[fd] == -1)
+	{
+		errno = ENOENT;
+		return false;
+	}
+	this->_pollFds[this->_indexByFd[fd]].events = toPollEvents(events);
+	return true;
+}
+
+void PollPoller::remove(int fd)
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= this->_indexByFd.size() || this->_indexByFd[fd] == -1)
+		return;
+
+	// Swap with the last entry so removal stays O(1)
+	int index = this->_indexByFd[fd];
+	int lastFd = this->_pollFds.back().fd;
+	this->_pollFds[index] = this->_pollFds.back();
+	this->_indexByFd[lastFd] = index;
+	this->_pollFds.pop_back();
+	this->_indexByFd[fd] = -1;
+}
+
+int PollPoller::wait(std::vector<PollEvent> &events, int timeoutMs)
+{
+	events.clear();
+	if (this->_pollFds.empty())
+		return poll(NULL, 0, timeoutMs);
+
+	int activity = poll(&this->_pollFds[0], this->_pollFds.size(), timeoutMs);
+	if (activity <= 0)
+		return activity;
+
+	for (size_t i = 0; i < this->_pollFds.size() && static_cast<int>(events.size()) < activity; ++i)
+	{
+		short revents = this->_pollFds[i].revents;
+		if (revents == 0)
+			continue;
+
+		PollEvent event;
+		event.fd = this->_pollFds[i].fd;
+		event.events = 0;
+		if (revents & POLLIN)
+			event.events |= POLLER_READ;
+		if (revents & POLLOUT)
+			event.events |= POLLER_WRITE;
+		if (revents & (POLLERR | POLLHUP | POLLNVAL))
+			event.events |= POLLER_ERROR;
+		events.push_back(event);
+	}
+	return events.size();
+}
+
+const char *PollPoller::getName() const
+{
+	return "poll";
+}
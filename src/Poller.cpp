@@ -0,0 +1,84 @@
+#include <Poller.hpp>
+#include <SelectPoller.hpp>
+#include <PollPoller.hpp>
+#include <EpollPoller.hpp>
+#include <UringPoller.hpp>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+
+Poller::~Poller() {}
+
+bool Poller::watchAccept(int) { return false; }
+bool Poller::watchRecv(int) { return false; }
+
+int Poller::takeAccepted(int)
+{
+	errno = EOPNOTSUPP;
+	return -1;
+}
+
+ssize_t Poller::takeReceived(int, std::string &, size_t)
+{
+	errno = EOPNOTSUPP;
+	return -1;
+}
+
+bool Poller::isSupported(const std::string &backend)
+{
+	if (backend == "select" || backend == "poll")
+		return true;
+#ifdef __linux__
+	if (backend == "epoll")
+		return true;
+#endif
+#ifdef WEBSERV_HAVE_IO_URING
+	if (backend == "io_uring")
+		return true;
+#endif
+	return false;
+}
+
+const char *Poller::getDefaultBackend()
+{
+#ifdef __linux__
+	return "epoll";
+#else
+	return "poll";
+#endif
+}
+
+Poller *Poller::create(const std::string &backend)
+{
+	if (backend == "select")
+		return new SelectPoller();
+	if (backend == "poll")
+		return new PollPoller();
+#ifdef __linux__
+	if (backend == "epoll")
+	{
+		EpollPoller *poller = new EpollPoller();
+		if (!poller->isValid())
+		{
+			delete poller;
+			return NULL;
+		}
+		return poller;
+	}
+#endif
+#ifdef WEBSERV_HAVE_IO_URING
+	// Probed at run time: older kernels, seccomp filters and
+	// kernel.io_uring_disabled all leave epoll as the way to go
+	if (backend == "io_uring")
+	{
+		UringPoller *poller = new UringPoller();
+		if (poller->isValid())
+			return poller;
+		int error = errno;
+		delete poller;
+		std::cerr << "Warning: io_uring is not available (" << strerror(error) << "), falling back to epoll" << std::endl;
+		return create("epoll");
+	}
+#endif
+	return NULL;
+}
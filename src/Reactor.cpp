@@ -0,0 +1,186 @@
+#include <Reactor.hpp>
+#include <ConfigStore.hpp>
+#include <HandoffQueue.hpp>
+#include <Server.hpp>
+#include <Upgrade.hpp>
+#include <CpuAffinity.hpp>
+#include <iostream>
+#include <cstring>
+#include <signal.h>
+#include <unistd.h>
+
+Reactor::Reactor(ConfigStore &configStore)
+	: _configStore(configStore), _reusePort(false), _upgradable(false), _readyFd(-1), _firstCpuSlot(0), _nextLoop(0) {}
+
+Reactor::~Reactor()
+{
+	this->stopLoops(false);
+}
+
+void Reactor::setEventBackend(const std::string &backend) { this->_eventBackend = backend; }
+void Reactor::setReusePort(bool reusePort) { this->_reusePort = reusePort; }
+void Reactor::setInheritedListeners(const std::vector<int> &listenFds) { this->_inheritedListeners = listenFds; }
+void Reactor::setUpgradable(bool upgradable) { this->_upgradable = upgradable; }
+void Reactor::setReadyFd(int readyFd) { this->_readyFd = readyFd; }
+
+void Reactor::setCpuAffinity(const std::vector<std::string> &affinity, int firstSlot)
+{
+	this->_cpuAffinity = affinity;
+	this->_firstCpuSlot = firstSlot;
+}
+
+void *Reactor::loopMain(void *arg)
+{
+	Server *server = static_cast<Server *>(arg);
+	server->run();
+	return NULL;
+}
+
+int Reactor::run(int threadCount)
+{
+	if (!this->startLoops(threadCount))
+	{
+		this->stopLoops(false);
+		return 1;
+	}
+
+	Server acceptor(this->_configStore);
+	acceptor.setDispatcher(this);
+	acceptor.setAdmissionControl(&this->_admission);
+	acceptor.setReusePort(this->_reusePort);
+	acceptor.setInheritedListeners(this->_inheritedListeners);
+	acceptor.setUpgradable(this->_upgradable);
+	if (!this->_eventBackend.empty())
+		acceptor.setEventBackend(this->_eventBackend);
+	if (!acceptor.initialize())
+	{
+		this->stopLoops(false);
+		return 1;
+	}
+	std::cout << "Acceptor dispatching to " << threadCount << " event-loop thread(s)" << std::endl;
+	if (this->_upgradable)
+		Upgrade::notifyReady();
+	Upgrade::reportReady(this->_readyFd);
+	this->_readyFd = -1;
+	acceptor.run();
+
+	// SIGTERM drained the acceptor's listeners; the loops drain their connections
+	this->stopLoops(acceptor.isDraining());
+	return 0;
+}
+
+bool Reactor::startLoops(int threadCount)
+{
+	// Loop threads inherit a mask blocking SIGINT/SIGTERM/SIGHUP/SIGUSR2, so only the
+	// acceptor thread is interrupted and decides when to stop or reload.
+	sigset_t blocked, previous;
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGINT);
+	sigaddset(&blocked, SIGTERM);
+	sigaddset(&blocked, SIGHUP);
+	sigaddset(&blocked, SIGUSR2);
+	pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+
+	bool ok = true;
+	this->_loops.reserve(threadCount);
+	for (int i = 0; i < threadCount && ok; ++i)
+	{
+		Loop loop;
+		loop.queue = new HandoffQueue();
+		loop.server = new Server(this->_configStore);
+		loop.started = false;
+		loop.cpu = CpuAffinity::getSlotCpu(this->_cpuAffinity, this->_firstCpuSlot + i);
+		this->_loops.push_back(loop);
+
+		if (!this->_eventBackend.empty())
+			loop.server->setEventBackend(this->_eventBackend);
+		loop.server->setHandoffQueue(loop.queue);
+		loop.server->setAdmissionControl(&this->_admission);
+		if (!loop.queue->isValid() || !loop.server->initialize())
+		{
+			std::cerr << "Error: Failed to initialize event-loop thread " << i << std::endl;
+			ok = false;
+			break;
+		}
+		int err = pthread_create(&this->_loops.back().thread, NULL, loopMain, loop.server);
+		if (err != 0)
+		{
+			std::cerr << "Error: pthread_create() failed: " << strerror(err) << std::endl;
+			ok = false;
+			break;
+		}
+		this->_loops.back().started = true;
+
+		// Before the loop sees its first connection, see CpuAffinity.hpp
+		cpu_set_t cpus;
+		if (CpuAffinity::getSlotCpus(this->_cpuAffinity, this->_firstCpuSlot + i, cpus) &&
+			(err = pthread_setaffinity_np(this->_loops.back().thread, sizeof(cpus), &cpus)) != 0)
+			std::cerr << "Error: Cannot pin event-loop thread " << i << " to its CPUs: " << strerror(err) << std::endl;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+	return ok;
+}
+
+// Either stops the loops at once or lets each drain its connections
+void Reactor::stopLoops(bool drain)
+{
+	HandoffQueue::Item stop;
+	memset(&stop, 0, sizeof(stop));
+	stop.fd = drain ? HandoffQueue::DRAIN : HandoffQueue::STOP;
+
+	for (size_t i = 0; i < this->_loops.size(); ++i)
+	{
+		if (!this->_loops[i].started)
+			continue;
+		while (!this->_loops[i].queue->push(stop))
+			usleep(1000);
+		this->_loops[i].queue->notify();
+	}
+	for (size_t i = 0; i < this->_loops.size(); ++i)
+	{
+		if (this->_loops[i].started)
+			pthread_join(this->_loops[i].thread, NULL);
+		delete this->_loops[i].server;
+		delete this->_loops[i].queue;
+	}
+	this->_loops.clear();
+}
+
+bool Reactor::dispatch(int clientFd, const std::string &ip, int port, const AdmissionControl::Ticket &admission)
+{
+	HandoffQueue::Item item;
+	item.fd = clientFd;
+	item.port = port;
+	item.admission = admission;
+	strncpy(item.ip, ip.c_str(), sizeof(item.ip) - 1);
+	item.ip[sizeof(item.ip) - 1] = '\0';
+
+	// SO_INCOMING_CPU: the loop on the CPU that took the packets has them in cache
+	int cpu = this->_cpuAffinity.empty() ? -1 : CpuAffinity::getIncomingCpu(clientFd);
+	for (size_t i = 0; cpu >= 0 && i < this->_loops.size(); ++i)
+	{
+		if (this->_loops[i].cpu == cpu && this->_loops[i].queue->push(item))
+		{
+			this->_loops[i].queue->notify();
+			return true;
+		}
+	}
+
+	// Try every loop once starting at the round-robin position
+	for (size_t attempt = 0; attempt < this->_loops.size(); ++attempt)
+	{
+		Loop &loop = this->_loops[this->_nextLoop];
+		this->_nextLoop = (this->_nextLoop + 1) % this->_loops.size();
+		if (loop.queue->push(item))
+		{
+			loop.queue->notify();
+			return true;
+		}
+	}
+
+	std::cerr << "Error: All event-loop queues are full, dropping connection " << clientFd << std::endl;
+	close(clientFd);
+	this->_admission.release(admission);
+	return false;
+}
@@ -53,7 +53,7 @@ void Request::parseFirstLine()
 	lineStream >> _method >> _uri >> _version;
 
 	if (_method.empty() || _uri.empty() || _version.empty() ||
-		_version != "HTTP/1.1")
+		(_version != "HTTP/1.1" && _version != "HTTP/1.0"))
 	{
 		_isValid = false;
 	}
@@ -211,6 +211,17 @@ std::vector<std::string> Request::getHeaderValues(const std::string &headerName)
 	return values;
 }
 
+bool Request::hasConnectionOption(const std::string &option) const
+{
+	std::vector<std::string> values = this->getHeaderValues("connection");
+	for (size_t i = 0; i < values.size(); ++i)
+	{
+		if (toLower(values[i]) == option)
+			return true;
+	}
+	return false;
+}
+
 std::string Request::toString() const
 {
 	std::ostringstream oss;
@@ -6,17 +6,40 @@ static int extractPort(const std::string &host);
 
 Response::Response(
 	const ConfigManager &configManager,
-	const Request &request) : _request(request),
-							  _body(""),
-							  _status(StatusCodes::OK),
-							  _configManager(configManager),
-							  _server(NULL),
-							  _errorFound(false),
-							  _connectionError(false),
-							  _isCGIRequest(false)
+	const Request &request,
+	const ClientConnection &client) : _request(request),
+									  _body(""),
+									  _status(StatusCodes::OK),
+									  _configManager(configManager),
+									  _server(NULL),
+									  _errorFound(false),
+									  _connectionError(false),
+									  _closeConnection(!client.isKeepAlive()),
+									  _keepAliveMax(0),
+									  _isCGIRequest(false),
+									  _ready(true)
 {
-	// Initialize the Host and Port
-	if (this->initPortAndHost() == -1)
+	int maxRequests = configManager.getKeepaliveRequests();
+	if (maxRequests > 0)
+		this->_keepAliveMax = maxRequests - client.getRequestCount();
+
+	// Nothing of a request that failed to parse is trusted, not even its Host
+	if (!request.isValid())
+	{
+		this->_matchedLocation = NULL;
+		this->setErrorFilePathForStatus(StatusCodes::BAD_REQUEST);
+		this->buildResponseContent();
+		return;
+	}
+
+	// Initialize the Host and Port: a Unix socket has no port to match the
+	// Host header against, its listener picks the server block instead
+	if (!client.getUnixListener().empty())
+	{
+		this->_host = client.getUnixListener();
+		this->_port = 0;
+	}
+	else if (this->initPortAndHost() == -1)
 	{
 		this->_matchedLocation = NULL;
 		this->setErrorFilePathForStatus(StatusCodes::INTERNAL_SERVER_ERROR);
@@ -96,6 +119,7 @@ Response::Response(
 		this->handleUnsupported();
 }
 
+// A copy does not own the script of a suspended original
 Response::Response(const Response &src) : _request(src._request), _configManager(src._configManager)
 {
 	std::cout << "Response created as a copy of Response" << std::endl;
@@ -113,6 +137,10 @@ Response::Response(const Response &src) : _request(src._request), _configManager
 	this->_matchedLocation = src._matchedLocation;
 	this->_errorFound = src._errorFound;
 	this->_connectionError = src._connectionError;
+	this->_closeConnection = src._closeConnection;
+	this->_keepAliveMax = src._keepAliveMax;
+	this->_isCGIRequest = src._isCGIRequest;
+	this->_ready = src._ready;
 }
 
 Response &Response::operator=(const Response &src)
@@ -134,24 +162,45 @@ Response &Response::operator=(const Response &src)
 		this->_matchedLocation = src._matchedLocation;
 		this->_errorFound = src._errorFound;
 		this->_connectionError = src._connectionError;
+		this->_closeConnection = src._closeConnection;
+		this->_keepAliveMax = src._keepAliveMax;
+		this->_isCGIRequest = src._isCGIRequest;
+		this->_ready = src._ready;
 	}
 	return (*this);
 }
 
 Response::~Response()
 {
+	// A client gone before its script finished
+	CGIHandler::abort(this->_cgi);
 	std::cout << "Response class destroyed" << std::endl;
 }
 
+// Persistence is decided by the Server; the Keep-Alive header tells the
+// client how long this one stays idle and how many more requests it takes
+std::string Response::getConnectionHeader() const
+{
+	if (this->closesConnection())
+		return "Connection: close\r\n";
+
+	std::ostringstream connection;
+	connection << "Connection: keep-alive\r\n"
+			   << "Keep-Alive: timeout=" << this->_configManager.getTimeouts().keepalive;
+	if (this->_keepAliveMax > 0)
+		connection << ", max=" << this->_keepAliveMax;
+	connection << "\r\n";
+	return connection.str();
+}
+
+bool Response::closesConnection() const
+{
+	return this->_connectionError || this->_closeConnection;
+}
+
 void Response::handleRedirect()
 {
-	std::string connection = "Connection: ";
-	const std::vector<std::string> connectionHeaderValues = this->_request.getHeaderValues("connection");
-	if (connectionHeaderValues.size() > 0)
-		connection += connectionHeaderValues[0];
-	else
-		connection += "close";
-	connection += "\r\n";
+	std::string connection = this->getConnectionHeader();
 
 	std::string location = "Location: " + this->_matchedLocation->redirect_url + "\r\n";
 
@@ -201,10 +250,50 @@ void Response::handleCGI()
 	env_var["server_name"] = "Webserv/1.0";
 	env_var["query_string"] = this->_request.getQueryString();
 
-	this->_body = CGIHandler::executeCGI(this->_filePath, this->_request.getBody(), env_var);
+	if (!CGIHandler::spawn(this->_filePath, this->_request.getBody(), env_var, this->_cgi))
+	{
+		this->setErrorFilePathForStatus(StatusCodes::INTERNAL_SERVER_ERROR);
+		this->buildResponseContent();
+		return;
+	}
+	this->_ready = false;
+	this->resume(TimerWheel::getMonotonicMillis());
+}
+
+bool Response::isReady() const
+{
+	return this->_ready;
+}
+
+void Response::resume(unsigned long nowMs)
+{
+	if (this->_ready)
+		return;
+
+	CGIHandler::Progress progress = CGIHandler::resume(this->_cgi, nowMs);
+	if (progress == CGIHandler::CGI_RUNNING)
+		return;
+
+	this->_ready = true;
+	if (progress == CGIHandler::CGI_DONE)
+		this->_body = this->_cgi.output;
+	else if (progress == CGIHandler::CGI_TIMED_OUT)
+		this->setErrorFilePathForStatus(StatusCodes::GATEWAY_ERROR);
+	else
+		this->setErrorFilePathForStatus(StatusCodes::INTERNAL_SERVER_ERROR);
 	this->buildResponseContent();
 }
 
+unsigned long Response::getDeadline(unsigned long nowMs) const
+{
+	return CGIHandler::getDeadline(this->_cgi, nowMs);
+}
+
+CGIHandler::Process &Response::getCGIProcess()
+{
+	return this->_cgi;
+}
+
 void Response::handleGet()
 {
 	// The constructor has already called setErrorFilePathForStatus for all ERROR cases
@@ -358,19 +447,7 @@ void Response::buildResponseContent()
 	contentType += this->mimeType;
 	contentType += "\r\n";
 
-	std::string connection = "Connection: ";
-
-	const std::vector<std::string> connectionHeaderValues = this->_request.getHeaderValues("connection");
-	if (this->_connectionError == true)
-		connection += "close";
-	else
-	{
-		if (connectionHeaderValues.size() > 0)
-			connection += connectionHeaderValues[0];
-		else
-			connection += "close";
-	}
-	connection += "\r\n";
+	std::string connection = this->getConnectionHeader();
 
 	// Server Information
 	static const std::string server = "Server: Webserv/1.0\r\n";
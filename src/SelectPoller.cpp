@@ -0,0 +1,102 @@
+#include <SelectPoller.hpp>
+#include <cerrno>
+
+SelectPoller::SelectPoller() : _maxFd(-1)
+{
+	FD_ZERO(&this->_masterReadFds);
+	FD_ZERO(&this->_masterWriteFds);
+	FD_ZERO(&this->_readFds);
+	FD_ZERO(&this->_writeFds);
+}
+
+SelectPoller::~SelectPoller() {}
+
+bool SelectPoller::add(int fd, unsigned int events)
+{
+	if (fd < 0 || fd >= FD_SETSIZE)
+	{
+		errno = EMFILE;
+		return false;
+	}
+	return this->modify(fd, events);
+}
+
+bool SelectPoller::modify(int fd, unsigned int events)
+{
+	if (fd < 0 || fd >= FD_SETSIZE)
+	{
+		errno = EBADF;
+		return false;
+	}
+
+	FD_CLR(fd, &this->_masterReadFds);
+	FD_CLR(fd, &this->_masterWriteFds);
+	if (events & POLLER_READ)
+		FD_SET(fd, &this->_masterReadFds);
+	if (events & POLLER_WRITE)
+		FD_SET(fd, &this->_masterWriteFds);
+
+	if (fd > this->_maxFd)
+		this->_maxFd = fd;
+	return true;
+}
+
+void SelectPoller::remove(int fd)
+{
+	if (fd < 0 || fd >= FD_SETSIZE)
+		return;
+
+	FD_CLR(fd, &this->_masterReadFds);
+	FD_CLR(fd, &this->_masterWriteFds);
+	if (fd == this->_maxFd)
+		this->recomputeMaxFd();
+}
+
+void SelectPoller::recomputeMaxFd()
+{
+	while (this->_maxFd >= 0 &&
+		   !FD_ISSET(this->_maxFd, &this->_masterReadFds) &&
+		   !FD_ISSET(this->_maxFd, &this->_masterWriteFds))
+		this->_maxFd--;
+}
+
+int SelectPoller::wait(std::vector<PollEvent> &events, int timeoutMs)
+{
+	events.clear();
+
+	// select() overwrites its sets, so start each wait from the master copies
+	this->_readFds = this->_masterReadFds;
+	this->_writeFds = this->_masterWriteFds;
+
+	struct timeval timeout;
+	struct timeval *timeoutPtr = NULL;
+	if (timeoutMs >= 0)
+	{
+		timeout.tv_sec = timeoutMs / 1000;
+		timeout.tv_usec = (timeoutMs % 1000) * 1000;
+		timeoutPtr = &timeout;
+	}
+
+	int activity = select(this->_maxFd + 1, &this->_readFds, &this->_writeFds, NULL, timeoutPtr);
+	if (activity <= 0)
+		return activity;
+
+	for (int fd = 0; fd <= this->_maxFd; ++fd)
+	{
+		PollEvent event;
+		event.fd = fd;
+		event.events = 0;
+		if (FD_ISSET(fd, &this->_readFds))
+			event.events |= POLLER_READ;
+		if (FD_ISSET(fd, &this->_writeFds))
+			event.events |= POLLER_WRITE;
+		if (event.events)
+			events.push_back(event);
+	}
+	return events.size();
+}
+
+const char *SelectPoller::getName() const
+{
+	return "select";
+}
@@ -4,24 +4,54 @@
 #include <netinet/in.h>
 #include <unistd.h>
 #include <cstring>
-#include <sys/select.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 #include <vector>
 #include <ClientConnection.hpp>
 #include <Response.hpp>
 #include <fcntl.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <sys/errno.h>
 #include <signal.h>
 #include <sstream>
 #include <ConfigManager.hpp>
+#include <ConfigStore.hpp>
 #include <Request.hpp>
+#include <ConnectionDispatcher.hpp>
+#include <HandoffQueue.hpp>
+#include <Upgrade.hpp>
+#include <UnixSocket.hpp>
+#include <sys/wait.h>
+#include <StatusCodes.hpp>
+#include <climits>
 
 // // Define static const members
 const int Server::_REUSE_ADDR_OPT = 1;
-const int Server::_MAX_CLIENT_CONN_QUEUE = 10;
+const int Server::_MAX_ACCEPTS_PER_EVENT = 128;
 const int Server::_TIMEOUT_SECONDS = 10;
 const size_t Server::_BUFFER_SIZE = 8192;
-bool Server::_signalReceived = false;
+const int Server::_MIN_FD_LOW_WATER = 32;
+const int Server::_MAX_REQUESTS_PER_TURN = 8;
+const size_t Server::_MAX_BYTES_PER_TURN = 256 * 1024;
+const size_t Server::_BULK_SEND_CHUNK = 64 * 1024;
+volatile sig_atomic_t Server::_signalReceived = 0;
+volatile sig_atomic_t Server::_reloadRequested = 0;
+volatile sig_atomic_t Server::_upgradeRequested = 0;
+
+// The signal flags are set by the handler on whichever thread took the
+// signal and read by every event-loop thread: volatile alone orders nothing
+static int loadSignalFlag(volatile sig_atomic_t &flag)
+{
+	return __atomic_load_n(&flag, __ATOMIC_ACQUIRE);
+}
+
+// Clears the flag and returns whether it was set, a signal arriving
+// meanwhile is not lost
+static bool takeSignalFlag(volatile sig_atomic_t &flag)
+{
+	return __atomic_exchange_n(&flag, 0, __ATOMIC_ACQ_REL) != 0;
+}
 
 template <typename T>
 static std::string toString(T value)
@@ -31,27 +61,79 @@ static std::string toString(T value)
 	return oss.str();
 }
 
-Server::Server(const ConfigManager &configManager) : _configManager(configManager)
+// Minimal 'Connection: close' response written by the event loop itself,
+// for failures detected before any request could be handed to Response
+static std::string buildConnectionErrorResponse(StatusCodes::Code code)
+{
+	std::ostringstream body;
+	body << "<html><body><h1>" << code << " " << StatusCodes::getMessage(code) << "</h1></body></html>";
+
+	std::ostringstream response;
+	response << "HTTP/1.1 " << code << " " << StatusCodes::getMessage(code) << "\r\n"
+			 << "Content-Type: text/html\r\n"
+			 << "Content-Length: " << body.str().size() << "\r\n"
+			 << "Connection: close\r\n"
+			 << "Server: Webserv/1.0\r\n\r\n"
+			 << body.str();
+	return response.str();
+}
+
+static const std::string REQUEST_TIMEOUT_RESPONSE = buildConnectionErrorResponse(StatusCodes::REQUEST_TIMEOUT);
+static const std::string SERVICE_UNAVAILABLE_RESPONSE = buildConnectionErrorResponse(StatusCodes::SERVICE_UNAVAILABLE);
+
+// User + system CPU time of the calling thread (the process where per-thread
+// accounting is unavailable); time spent blocked in the poller is not counted
+static unsigned long getCpuMicroseconds()
+{
+	struct rusage usage;
+#ifdef RUSAGE_THREAD
+	getrusage(RUSAGE_THREAD, &usage);
+#else
+	getrusage(RUSAGE_SELF, &usage);
+#endif
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000UL +
+		   usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+Server::Server(ConfigStore &configStore)
+	: _configStore(configStore), _timers(TimerWheel::getMonotonicMillis())
 {
+	this->_snapshot = configStore.acquire();
+	this->_config = &this->_snapshot->config;
 
 	// I/O Multiplexing
-	this->_maxFd = -1;
-	FD_ZERO(&this->_readFds);
-	FD_ZERO(&this->_writeFds);
-	FD_ZERO(&this->_exceptFds);
+	this->_poller = NULL;
+	this->_eventBackend = this->_config->getEventBackend();
+	this->_completionAccept = false;
+	this->_loopIterations = 0;
+	this->_loopCpuMicros = 0;
+	this->_backpressurePauses = 0;
+	this->_peakPendingOutput = 0;
 
 	// Server State
 	this->_running = false;
 	this->_initialized = false;
 	this->_shutdownRequested = false;
+	this->_reusePort = false;
+	this->_incomingCpu = -1;
+	this->_draining = false;
+	this->_drainDeadline = 0;
+	this->_upgradable = false;
+	this->_upgradePid = -1;
+	this->_dispatcher = NULL;
+	this->_handoffQueue = NULL;
 
 	// Timing
-	this->_lastCleanup = time(NULL);
 	this->_timeout.tv_sec = _TIMEOUT_SECONDS;
 	this->_timeout.tv_usec = 0;
 
 	// Connections
-	this->_clients = std::map<int, ClientConnection *>();
+	this->_clients = std::vector<ClientConnection *>(1024, static_cast<ClientConnection *>(NULL));
+	this->_clientCount = 0;
+	this->_admission = &this->_ownAdmission;
+	this->_fdLimit = 0;
+	this->_fdLowWater = 0;
+	this->_spareFd = -1;
 	this->_listeningSockets = std::map<int, const ServerConfig *>();
 
 	this->totalRequestsCount = 0;
@@ -64,13 +146,23 @@ Server::~Server()
 
 	this->_listeningSockets.clear();
 
-	// Clean up all clients
-	std::map<int, ClientConnection *>::iterator it;
-	for (it = this->_clients.begin(); it != this->_clients.end(); it++)
+	// Clean up all clients, the pool frees the objects
+	for (size_t fd = 0; fd < this->_clients.size(); fd++)
 	{
-		delete it->second;
+		if (!this->_clients[fd])
+			continue;
+		if (this->_clients[fd]->getPendingResponse())
+			this->releasePendingResponse(this->_clients[fd]);
+		this->_pool.release(this->_clients[fd]);
 	}
 	this->_clients.clear();
+	this->_clientCount = 0;
+
+	if (this->_spareFd >= 0)
+		close(this->_spareFd);
+	this->printLoopStatistics();
+	delete this->_poller;
+	this->_configStore.release(this->_snapshot);
 }
 
 // Lifecycle
@@ -78,9 +170,37 @@ bool Server::initialize()
 {
 	signal(SIGINT, signalHandler);
 	signal(SIGTERM, signalHandler);
+	signal(SIGHUP, signalHandler);
 	signal(SIGPIPE, SIG_IGN);
+	if (this->_upgradable)
+		signal(SIGUSR2, signalHandler);
+
+	if (this->_eventBackend.empty())
+		this->_eventBackend = Poller::getDefaultBackend();
+	this->_poller = Poller::create(this->_eventBackend);
+	if (!this->_poller)
+	{
+		logError("Event backend '" + this->_eventBackend + "' is not available: " + strerror(errno));
+		return false;
+	}
+	std::cout << "Using " << this->_poller->getName() << " event backend" << std::endl;
 
-	const std::vector<ServerConfig> &serverConfigs = this->_configManager.getServers();
+	struct rlimit fdLimit;
+	this->_fdLimit = (getrlimit(RLIMIT_NOFILE, &fdLimit) == 0 && fdLimit.rlim_cur < static_cast<rlim_t>(INT_MAX))
+						 ? static_cast<int>(fdLimit.rlim_cur)
+						 : INT_MAX;
+	this->_fdLowWater = std::max(_MIN_FD_LOW_WATER, this->_fdLimit / 16);
+
+	// Event-loop threads only serve connections handed over by the acceptor
+	if (this->_handoffQueue)
+	{
+		if (!this->registerFd(this->_handoffQueue->getWakeFd(), POLLER_READ))
+			return false;
+		this->_initialized = true;
+		return true;
+	}
+
+	const std::vector<ServerConfig> &serverConfigs = this->_config->getServers();
 	if (serverConfigs.empty())
 	{
 		logError("No server configurations found.");
@@ -89,73 +209,337 @@ bool Server::initialize()
 	for (size_t i = 0; i < serverConfigs.size(); i++)
 	{
 		const ServerConfig &currentConfig = serverConfigs[i];
-		int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+		int listenFd = this->adoptListener(currentConfig);
+		if (listenFd < 0)
+			listenFd = this->openListener(currentConfig);
 		if (listenFd < 0)
 		{
-			logError("Failed to create socket for " + currentConfig.host + ":" + toString(currentConfig.port) + ": " + strerror(errno));
+			this->closeInheritedListeners();
 			return false;
 		}
 
-		// Set socket options for reuse address
-		if (setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &this->_REUSE_ADDR_OPT, sizeof(this->_REUSE_ADDR_OPT)) < 0)
+		this->_listeningSockets[listenFd] = &currentConfig;
+		if (!this->registerFd(listenFd, POLLER_READ))
 		{
-			logError("Failed to set SO_REUSEADDR for " + currentConfig.host + ":" + toString(currentConfig.port) + ": " + strerror(errno));
 			close(listenFd);
+			this->closeInheritedListeners();
 			return false;
 		}
+		if (this->_poller->watchAccept(listenFd))
+			this->_completionAccept = true;
+	}
+	this->closeInheritedListeners(); // Addresses no longer configured
+	this->_spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+	this->_initialized = true;
+	return true;
+}
 
-		// Set socket to non-blocking
-		if (!this->setNonBlocking(listenFd))
+// Convert host string to network address (supports IP and localhost)
+static bool resolveListenAddress(const ServerConfig &config, struct sockaddr_in &address)
+{
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(config.port);
+
+	// Convert the localhost
+	std::string host;
+	if (config.host == "localhost")
+		host = "127.0.0.1";
+	else
+		host = config.host;
+	return inet_pton(AF_INET, host.c_str(), &address.sin_addr) > 0;
+}
+
+// Creates, binds and starts listening on the socket for one server block.
+// Returns the fd, or -1 after logging why it failed.
+int Server::openListener(const ServerConfig &config)
+{
+	// With worker_processes the master opens these up front, see Master::openUnixListeners(),
+	// and a reload cannot add any, see ConfigStore::setUnixListenersFixed()
+	if (config.isUnixSocket())
+	{
+		int listenFd = UnixSocket::listen(config.getUnixPath(), config.listen_backlog);
+		if (listenFd < 0)
 		{
-			logError("Failed to set non-blocking for " + currentConfig.host + ":" + toString(currentConfig.port) + ": " + strerror(errno));
-			close(listenFd);
-			return false;
+			logError("Failed to listen on " + config.host + ": " + strerror(errno));
+			return -1;
 		}
+		this->configureListener(listenFd, config);
+		std::cout << "Server listening on " << config.host << std::endl;
+		return listenFd;
+	}
 
-		struct sockaddr_in serverAddress;
-		memset(&serverAddress, 0, sizeof(serverAddress));
-		serverAddress.sin_family = AF_INET;
-		serverAddress.sin_port = htons(currentConfig.port);
+	int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listenFd < 0)
+	{
+		logError("Failed to create socket for " + config.host + ":" + toString(config.port) + ": " + strerror(errno));
+		return -1;
+	}
 
-		// Convert the localhost
-		std::string host;
-		if (currentConfig.host == "localhost")
-			host = "127.0.0.1";
-		else
-			host = currentConfig.host;
+	// Set socket options for reuse address
+	if (setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &this->_REUSE_ADDR_OPT, sizeof(this->_REUSE_ADDR_OPT)) < 0)
+	{
+		logError("Failed to set SO_REUSEADDR for " + config.host + ":" + toString(config.port) + ": " + strerror(errno));
+		close(listenFd);
+		return -1;
+	}
+
+#ifdef SO_REUSEPORT
+	// Every worker binds its own listener, the kernel balances connections between them
+	if (this->_reusePort &&
+		setsockopt(listenFd, SOL_SOCKET, SO_REUSEPORT, &this->_REUSE_ADDR_OPT, sizeof(this->_REUSE_ADDR_OPT)) < 0)
+	{
+		logError("Failed to set SO_REUSEPORT for " + config.host + ":" + toString(config.port) + ": " + strerror(errno));
+		close(listenFd);
+		return -1;
+	}
+#endif
+#ifdef SO_INCOMING_CPU
+	// A pinned worker asks for the connections whose packets its CPU
+	// receives (honoured within SO_REUSEPORT groups since Linux 6.2)
+	if (this->_reusePort && this->_incomingCpu >= 0 &&
+		setsockopt(listenFd, SOL_SOCKET, SO_INCOMING_CPU, &this->_incomingCpu, sizeof(this->_incomingCpu)) < 0)
+		logError("Failed to set SO_INCOMING_CPU for " + config.host + ":" + toString(config.port) + ": " + strerror(errno));
+#endif
+
+	// Set socket to non-blocking
+	if (!this->setNonBlocking(listenFd))
+	{
+		logError("Failed to set non-blocking for " + config.host + ":" + toString(config.port) + ": " + strerror(errno));
+		close(listenFd);
+		return -1;
+	}
+
+	// Before listen(): the receive buffer decides the window scale offered in the SYN-ACK
+	this->configureListener(listenFd, config);
+
+	struct sockaddr_in serverAddress;
+	if (!resolveListenAddress(config, serverAddress))
+	{
+		logError("Invalid address or address not supported: " + config.host + ": " + strerror(errno));
+		close(listenFd);
+		return -1;
+	}
+
+	// Bind the socket to the address and port
+	if (bind(listenFd, (struct sockaddr *)&serverAddress, sizeof(serverAddress)) < 0)
+	{
+		logError("Failed to bind socket to " + config.host + ":" + toString(config.port) + ": " + strerror(errno));
+		close(listenFd);
+		return -1;
+	}
+
+	// Start listening for incoming connections
+	if (listen(listenFd, config.listen_backlog) < 0)
+	{
+		logError("Failed to listen on socket for " + config.host + ":" + toString(config.port) + ": " + strerror(errno));
+		close(listenFd);
+		return -1;
+	}
+
+	std::cout << "Server listening on http://" << config.host << ":" << toString(config.port) << std::endl;
+	return listenFd;
+}
+
+// Takes over an inherited listener bound to the block's address, if any.
+// Returns the fd, or -1 when the address has to be bound afresh.
+int Server::adoptListener(const ServerConfig &config)
+{
+	for (size_t i = 0; config.isUnixSocket() && i < this->_inheritedListeners.size(); ++i)
+	{
+		int listenFd = this->_inheritedListeners[i];
+		if (listenFd < 0 || UnixSocket::getBoundPath(listenFd) != config.getUnixPath())
+			continue;
+
+		this->_inheritedListeners[i] = -1;
+		this->setNonBlocking(listenFd);
+		this->configureListener(listenFd, config);
+		listen(listenFd, config.listen_backlog);
+		std::cout << "Server listening on " << config.host << " (inherited)" << std::endl;
+		return listenFd;
+	}
+
+	struct sockaddr_in wanted;
+	if (!resolveListenAddress(config, wanted))
+		return -1;
+
+	for (size_t i = 0; i < this->_inheritedListeners.size(); ++i)
+	{
+		int listenFd = this->_inheritedListeners[i];
+		struct sockaddr_in bound;
+		socklen_t length = sizeof(bound);
+		if (listenFd < 0 || getsockname(listenFd, (struct sockaddr *)&bound, &length) < 0 ||
+			bound.sin_family != AF_INET || bound.sin_port != wanted.sin_port ||
+			bound.sin_addr.s_addr != wanted.sin_addr.s_addr)
+			continue;
+
+		this->_inheritedListeners[i] = -1;
+		this->setNonBlocking(listenFd);
+		this->configureListener(listenFd, config);
+		listen(listenFd, config.listen_backlog);
+		std::cout << "Server listening on http://" << config.host << ":" << toString(config.port) << " (inherited)" << std::endl;
+		return listenFd;
+	}
+	return -1;
+}
+
+void Server::setListenerOption(int listenFd, int level, int option, int value, const char *name, const ServerConfig &config)
+{
+	if (setsockopt(listenFd, level, option, &value, sizeof(value)) == 0)
+		return;
+	std::string address = config.isUnixSocket() ? config.host : config.host + ":" + toString(config.port);
+	logError(std::string("Failed to set ") + name + " for " + address + ": " + strerror(errno));
+}
+
+// Applies the 'listen' parameters. Accepted connections inherit them from
+// the listener, so none of this costs a system call per connection. Also
+// run for inherited listeners and on reload; a failure is logged and the
+// listener kept with the system default.
+void Server::configureListener(int listenFd, const ServerConfig &config)
+{
+	if (config.sndbuf > 0)
+		this->setListenerOption(listenFd, SOL_SOCKET, SO_SNDBUF, config.sndbuf, "SO_SNDBUF", config);
+	if (config.rcvbuf > 0)
+		this->setListenerOption(listenFd, SOL_SOCKET, SO_RCVBUF, config.rcvbuf, "SO_RCVBUF", config);
+	if (config.isUnixSocket())
+		return;
+
+	// Responses leave in one send() and pipelined ones are batched, Nagle's
+	// algorithm would only hold back the tail of each write
+	this->setListenerOption(listenFd, IPPROTO_TCP, TCP_NODELAY, config.tcp_nodelay ? 1 : 0, "TCP_NODELAY", config);
+#ifdef TCP_DEFER_ACCEPT
+	// Only wake up once the client has actually sent data
+	if (config.defer_accept > 0)
+		this->setListenerOption(listenFd, IPPROTO_TCP, TCP_DEFER_ACCEPT, config.defer_accept, "TCP_DEFER_ACCEPT", config);
+#endif
+#ifdef TCP_FASTOPEN
+	// Needs the server bit (2) of net.ipv4.tcp_fastopen
+	if (config.fastopen > 0)
+		this->setListenerOption(listenFd, IPPROTO_TCP, TCP_FASTOPEN, config.fastopen, "TCP_FASTOPEN", config);
+#endif
+#ifdef TCP_NOTSENT_LOWAT
+	// Keeps unsent data in our write buffer rather than in the kernel's, so
+	// the SRPT write queue still decides what goes out next
+	if (config.notsent_lowat > 0)
+		this->setListenerOption(listenFd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, config.notsent_lowat, "TCP_NOTSENT_LOWAT", config);
+#endif
+#ifdef SO_BUSY_POLL
+	// Raising it above net.core.busy_read needs CAP_NET_ADMIN
+	if (config.busy_poll > 0)
+		this->setListenerOption(listenFd, SOL_SOCKET, SO_BUSY_POLL, config.busy_poll, "SO_BUSY_POLL", config);
+#endif
+}
+
+void Server::closeInheritedListeners()
+{
+	for (size_t i = 0; i < this->_inheritedListeners.size(); ++i)
+	{
+		if (this->_inheritedListeners[i] < 0)
+			continue;
+		std::cerr << "Warning: closing inherited listener fd " << this->_inheritedListeners[i] << ": no matching server block" << std::endl;
+		close(this->_inheritedListeners[i]);
+	}
+	this->_inheritedListeners.clear();
+}
+
+// Re-executes the binary with the listeners inherited. This process keeps
+// serving until the new one reports it is ready with SIGTERM, see Upgrade.hpp.
+void Server::startUpgrade()
+{
+	if (this->_upgradePid > 0 || this->_draining)
+		return;
+
+	std::vector<int> listenFds;
+	std::map<int, const ServerConfig *>::iterator it;
+	for (it = this->_listeningSockets.begin(); it != this->_listeningSockets.end(); ++it)
+		listenFds.push_back(it->first);
 
-		// Convert host string to network address (supports IP and localhost)
-		if (inet_pton(AF_INET, host.c_str(), &serverAddress.sin_addr) <= 0)
+	this->_upgradePid = Upgrade::spawn(listenFds);
+	if (this->_upgradePid < 0)
+	{
+		logError(std::string("Upgrade: cannot start the new binary: ") + strerror(errno));
+		return;
+	}
+	std::cout << "Upgrade: started new binary with pid " << this->_upgradePid << std::endl;
+}
+
+// Notices a new binary that died before taking over
+void Server::checkUpgrade()
+{
+	int status;
+	if (waitpid(this->_upgradePid, &status, WNOHANG) != this->_upgradePid)
+		return;
+	logError("Upgrade: new binary " + toString(this->_upgradePid) + " exited before taking over, still serving");
+	this->_upgradePid = -1;
+}
+
+// Trades the held snapshot for the newest one. Nothing else keeps a reference
+// across iterations: responses are built within a single call.
+void Server::adoptConfig()
+{
+	ConfigStore::Snapshot *previous = this->_snapshot;
+	this->_snapshot = this->_configStore.acquire();
+	this->_config = &this->_snapshot->config;
+
+	// Loop threads have no listeners, a draining server must not reopen them
+	if (!this->_handoffQueue && !this->_draining)
+		this->updateListeners();
+	this->_configStore.release(previous);
+}
+
+// Keeps the listeners whose address is still configured, opens the new ones
+// and closes those that were removed. Connections in progress are untouched.
+void Server::updateListeners()
+{
+	std::map<int, const ServerConfig *> previous = this->_listeningSockets;
+	std::map<int, const ServerConfig *> updated;
+	const std::vector<ServerConfig> &serverConfigs = this->_config->getServers();
+
+	for (size_t i = 0; i < serverConfigs.size(); i++)
+	{
+		const ServerConfig &currentConfig = serverConfigs[i];
+
+		std::map<int, const ServerConfig *>::iterator it;
+		for (it = previous.begin(); it != previous.end(); ++it)
 		{
-			logError("Invalid address or address not supported: " + currentConfig.host + ": " + strerror(errno));
-			close(listenFd);
-			return false;
+			if (it->second->host == currentConfig.host && it->second->port == currentConfig.port)
+				break;
 		}
-
-		// Bind the socket to the address and port
-		if (bind(listenFd, (struct sockaddr *)&serverAddress, sizeof(serverAddress)) < 0)
+		if (it != previous.end())
 		{
-			logError("Failed to bind socket to " + currentConfig.host + ":" + toString(currentConfig.port) + ": " + strerror(errno));
-			close(listenFd);
-			return false;
+			// Same address: point it at the new block, changed parameters apply at once
+			this->configureListener(it->first, currentConfig);
+			listen(it->first, currentConfig.listen_backlog);
+			updated[it->first] = &currentConfig;
+			previous.erase(it);
+			continue;
 		}
 
-		// Start listening for incoming connections
-		if (listen(listenFd, this->_MAX_CLIENT_CONN_QUEUE) < 0)
+		int listenFd = this->openListener(currentConfig);
+		if (listenFd < 0)
+			continue; // Already logged, the other listeners keep serving
+		if (!this->registerFd(listenFd, POLLER_READ))
 		{
-			logError("Failed to listen on socket for " + currentConfig.host + ":" + toString(currentConfig.port) + ": " + strerror(errno));
 			close(listenFd);
-			return false;
+			continue;
 		}
-
-		std::cout << "Server listening on http://" << currentConfig.host << ":" << toString(currentConfig.port) << std::endl;
-		this->_listeningSockets[listenFd] = &currentConfig;
-		FD_SET(listenFd, &this->_readFds);
-		this->_maxFd = std::max(this->_maxFd, listenFd);
+		if (this->_poller->watchAccept(listenFd))
+			this->_completionAccept = true;
+		updated[listenFd] = &currentConfig;
 	}
 
-	this->_initialized = true;
-	return true;
+	std::map<int, const ServerConfig *>::iterator it;
+	for (it = previous.begin(); it != previous.end(); ++it)
+	{
+		if (it->second->isUnixSocket())
+			std::cout << "Server no longer listening on " << it->second->host << std::endl;
+		else
+			std::cout << "Server no longer listening on http://" << it->second->host << ":" << toString(it->second->port) << std::endl;
+		this->_poller->remove(it->first);
+		close(it->first);
+	}
+	this->_listeningSockets = updated;
 }
 
 void Server::run()
@@ -168,17 +552,37 @@ void Server::run()
 
 	this->_running = true;
 	this->_timeout.tv_usec = 0;
+	unsigned long cpuStart = getCpuMicroseconds();
 
-	while (this->_running && !this->_shutdownRequested && !_signalReceived)
+	while (this->_running && !this->_shutdownRequested && loadSignalFlag(_signalReceived) != SIGINT)
 	{
-		// Copy master fd_sets to temporary sets for select()
-		this->setupFdSets();
-
-		// Use _timeout for select, it will be modified by select() so we reset it each loop
-		struct timeval currentTimeout = this->_timeout;
-		int activity = select(this->_maxFd + 1, &this->_readFds, &this->_writeFds, &this->_exceptFds, &currentTimeout);
+		if (loadSignalFlag(_signalReceived) == SIGTERM && !this->_draining)
+			this->drain();
+		if (this->_draining && this->isDrained())
+			break;
 
-		if (_signalReceived)
+		if (this->_upgradable && takeSignalFlag(_upgradeRequested))
+			this->startUpgrade();
+		if (this->_upgradePid > 0)
+			this->checkUpgrade();
+
+		// Loop threads leave the reload to the acceptor and only adopt its result
+		if (!this->_handoffQueue && takeSignalFlag(_reloadRequested))
+			this->_configStore.reload();
+
+		// Interest is kept up to date by updateClientInterest(), nothing to rebuild here.
+		// Sleep until the next client deadline, bounded by _timeout.
+		int timeoutMs = this->_timeout.tv_sec * 1000 + this->_timeout.tv_usec / 1000;
+		long nextDeadline = this->_timers.getNextTimeoutMs(TimerWheel::getMonotonicMillis());
+		if (nextDeadline >= 0 && nextDeadline < timeoutMs)
+			timeoutMs = nextDeadline;
+		if (!this->_deferredClients.empty())
+			timeoutMs = 0; // Only collect what else is ready, deferred work is waiting
+		if (this->_draining)
+			timeoutMs = std::min(timeoutMs, static_cast<int>(this->_drainDeadline - std::min(this->_drainDeadline, TimerWheel::getMonotonicMillis())));
+		int activity = this->_poller->wait(this->_events, timeoutMs);
+
+		if (loadSignalFlag(_signalReceived) == SIGINT)
 		{
 			break; // Exit loop on signal
 		}
@@ -188,21 +592,30 @@ void Server::run()
 			{
 				continue; // Interrupted by signal
 			}
-			logError("select() failed: " + std::string(strerror(errno)));
+			logError(std::string(this->_poller->getName()) + " wait failed: " + strerror(errno));
 			break;
 		}
 
-		if (activity == 0)
-		{
-			// Timed Out - Check for client timeouts
-			this->cleanupTimedOutClients();
-			continue;
-		}
+		// Requests read from here on see the newest configuration
+		if (this->_configStore.getGeneration() != this->_snapshot->generation)
+			this->adoptConfig();
 
 		// Process the file descriptors that have activity
-		this->processFdSets();
+		if (activity > 0)
+			this->processEvents();
+		this->processDeferredClients();
+		this->flushWriteQueue();
+
+		// Expire deadlines on every iteration, busy or not. A CGI past its
+		// deadline is answered here, its 504 is flushed right away.
+		this->cleanupTimedOutClients();
+		this->flushWriteQueue();
+		this->relieveFdPressure();
 		this->processClientRemovalQueue();
+
+		this->_loopIterations++;
 	}
+	this->_loopCpuMicros = getCpuMicroseconds() - cpuStart;
 }
 
 void Server::stop()
@@ -213,37 +626,61 @@ void Server::stop()
 // Client Management
 bool Server::addClient(int clientFd)
 {
-	// ClientConnection constructor takes an int fd
-	this->_clients[clientFd] = new ClientConnection(clientFd);
-	// Update maxFd if necessary
-	if (clientFd > _maxFd)
+	if (clientFd < 0)
+		return false;
+	if (static_cast<size_t>(clientFd) >= this->_clients.size())
+		this->_clients.resize(std::max(this->_clients.size() * 2, static_cast<size_t>(clientFd) + 1), NULL);
+
+	ClientConnection *client = this->_pool.acquire(clientFd);
+	this->_clients[clientFd] = client;
+	this->_clientCount++;
+	this->updateClientInterest(client);
+	if (!client->isPollRegistered())
 	{
-		_maxFd = clientFd;
+		// Registration failed, release() closes the socket
+		this->_clients[clientFd] = NULL;
+		this->_clientCount--;
+		this->_pool.release(client);
+		return false;
 	}
+	if (this->_poller->watchRecv(clientFd))
+		client->setReceiver(this->_poller);
+	this->touchClient(client);
 	return true;
 }
 
 ClientConnection *Server::getClient(int clientFd)
 {
-	std::map<int, ClientConnection *>::iterator it = this->_clients.find(clientFd);
-	if (it == this->_clients.end())
+	if (clientFd < 0 || static_cast<size_t>(clientFd) >= this->_clients.size())
 		return NULL;
-	return it->second;
+	return this->_clients[clientFd];
 }
 
 void Server::markClientForRemoval(int clientFd)
 {
+	ClientConnection *client = this->getClient(clientFd);
+	if (!client || client->isMarkedForRemoval())
+		return;
+	client->setMarkedForRemoval();
 	this->_clientsToRemove.push_back(clientFd);
 }
 
 // Getters
-int Server::getClientCount() const { return this->_clients.size(); }
+int Server::getClientCount() const { return this->_clientCount; }
 bool Server::isRunning() const { return this->_running; }
 bool Server::isInitialized() const { return this->_initialized; }
-int Server::getMaxFd() const { return this->_maxFd; }
 
 void Server::setTimeout(int seconds) { this->_timeout.tv_sec = seconds; }
 void Server::setBufferSize(size_t size) { (void)size; /* TODO: Think if necessary */ }
+void Server::setEventBackend(const std::string &backend) { this->_eventBackend = backend; }
+void Server::setReusePort(bool reusePort) { this->_reusePort = reusePort; }
+void Server::setIncomingCpu(int cpu) { this->_incomingCpu = cpu; }
+void Server::setDispatcher(ConnectionDispatcher *dispatcher) { this->_dispatcher = dispatcher; }
+void Server::setHandoffQueue(HandoffQueue *queue) { this->_handoffQueue = queue; }
+void Server::setAdmissionControl(AdmissionControl *admission) { this->_admission = admission; }
+void Server::setInheritedListeners(const std::vector<int> &listenFds) { this->_inheritedListeners = listenFds; }
+void Server::setUpgradable(bool upgradable) { this->_upgradable = upgradable; }
+const std::string &Server::getEventBackend() const { return this->_eventBackend; }
 
 bool Server::setNonBlocking(int fd)
 {
@@ -262,53 +699,120 @@ bool Server::setNonBlocking(int fd)
 }
 
 // Connection Management
-void Server::handleNewConnection(int listenFd) // Parameter added
+// Accepts a connection that is already non-blocking and close-on-exec.
+// A poller that accepts ahead of time returns no address, it is asked for.
+int Server::acceptClient(int listenFd, struct sockaddr_in &clientAddress)
 {
-	struct sockaddr_in clientAddress;
 	socklen_t clientLen = sizeof(clientAddress);
-	int clientFd = accept(listenFd, (struct sockaddr *)&clientAddress, &clientLen);
-
-	if (clientFd < 0)
+	if (this->_completionAccept)
 	{
-		if (errno == EAGAIN || errno == EWOULDBLOCK)
-		{
-			// No pending connections, just return
-			return;
-		}
-		logError("accept() failed on listenFd " + toString(listenFd) + ": " + strerror(errno));
-		return;
+		int clientFd = this->_poller->takeAccepted(listenFd);
+		if (clientFd >= 0)
+			getpeername(clientFd, (struct sockaddr *)&clientAddress, &clientLen);
+		return clientFd;
 	}
-
-	if (!setNonBlocking(clientFd))
+#ifdef __linux__
+	return accept4(listenFd, (struct sockaddr *)&clientAddress, &clientLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+	int clientFd = accept(listenFd, (struct sockaddr *)&clientAddress, &clientLen);
+	if (clientFd < 0)
+		return -1;
+	if (!setNonBlocking(clientFd) || fcntl(clientFd, F_SETFD, FD_CLOEXEC) == -1)
 	{
-		logError("Failed to set client socket non-blocking for fd " + toString(clientFd));
 		close(clientFd);
-		return;
+		errno = EBADF;
+		return -1;
 	}
+	return clientFd;
+#endif
+}
 
-	// Add client to master read set
-	FD_SET(clientFd, &_masterReadFds);
-	if (clientFd > _maxFd)
+// Drains the accept queue until EAGAIN, capped so a connection burst on
+// one listener cannot starve the clients that are already being served.
+// Connections over a limit get a prebuilt 503 and are closed unallocated.
+void Server::handleNewConnection(int listenFd)
+{
+	std::map<int, const ServerConfig *>::const_iterator listener = this->_listeningSockets.find(listenFd);
+	AdmissionControl::Limits limits;
+	limits.total = this->_config->getMaxConnections();
+	limits.perServer = (listener != this->_listeningSockets.end()) ? listener->second->max_connections : 0;
+	limits.perIp = this->_config->getMaxConnectionsPerIp();
+
+	// Unix socket peers have no address, the local proxy is not limited per IP
+	bool unixListener = (listener != this->_listeningSockets.end() && listener->second->isUnixSocket());
+	if (unixListener)
+		limits.perIp = 0;
+
+	for (int accepted = 0; accepted < _MAX_ACCEPTS_PER_EVENT; ++accepted)
 	{
-		_maxFd = clientFd;
-	}
+		struct sockaddr_in clientAddress;
+		memset(&clientAddress, 0, sizeof(clientAddress));
+		int clientFd = this->acceptClient(listenFd, clientAddress);
 
-	if (!addClient(clientFd))
-	{
-		logError("Failed to add client " + toString(clientFd));
-		close(clientFd);
-		FD_CLR(clientFd, &_masterReadFds);
-		return;
-	}
+		if (clientFd < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return; // Queue drained
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue; // Transient, try the next pending connection
+			if (errno == EMFILE || errno == ENFILE)
+			{
+				// Out of fds: relieveFdPressure() evicts idle clients at the end of
+				// this iteration and the listener, still readable, is retried after.
+				// With none to evict, refuse one connection so the loop cannot spin.
+				this->_admission->setFdHeadroom(0);
+				if (this->_dispatcher || this->_idleClients.size() == 0)
+					this->refuseWithSpareFd(listenFd);
+				return;
+			}
+			logError("accept() failed on listenFd " + toString(listenFd) + ": " + strerror(errno));
+			return;
+		}
+
+		// Lowest free fd first: every fd below clientFd is in use
+		this->_admission->setFdHeadroom(this->_fdLimit - 1 - clientFd);
 
-	char clientIp[INET_ADDRSTRLEN];
-	inet_ntop(AF_INET, &(clientAddress.sin_addr), clientIp, INET_ADDRSTRLEN);
-	int clientPort = ntohs(clientAddress.sin_port);
+		AdmissionControl::Ticket ticket;
+		ticket.listener = listenFd;
+		ticket.address = clientAddress.sin_addr.s_addr;
+		if (!this->_admission->admit(ticket, limits))
+		{
+			send(clientFd, SERVICE_UNAVAILABLE_RESPONSE.c_str(), SERVICE_UNAVAILABLE_RESPONSE.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+			close(clientFd);
+			continue;
+		}
 
-	_clients[clientFd]->setClientInfo(clientIp, clientPort);
+		char clientIp[INET_ADDRSTRLEN];
+		if (unixListener)
+			strcpy(clientIp, UnixSocket::PREFIX);
+		else
+			inet_ntop(AF_INET, &(clientAddress.sin_addr), clientIp, INET_ADDRSTRLEN);
+		int clientPort = ntohs(clientAddress.sin_port);
 
-	std::cout << "New connection accepted on FD " << listenFd << ", client FD: " << clientFd
-			  << " from " << clientIp << ":" << clientPort << std::endl;
+		// Acceptor of the threaded reactor: the connection is served by a loop thread
+		if (this->_dispatcher)
+		{
+			this->_dispatcher->dispatch(clientFd, clientIp, clientPort, ticket);
+			continue;
+		}
+
+		// addClient() closes the fd itself if registration with the poller fails
+		if (!addClient(clientFd))
+		{
+			logError("Failed to add client " + toString(clientFd));
+			this->_admission->release(ticket);
+			continue;
+		}
+		this->_clients[clientFd]->setClientInfo(clientIp, clientPort);
+		this->_clients[clientFd]->setAdmissionTicket(ticket);
+		if (unixListener)
+			this->_clients[clientFd]->setUnixListener(listener->second->host);
+
+#ifdef DEBUG
+		std::cout << "New connection accepted on FD " << listenFd << ", client FD: " << clientFd
+				  << " from " << clientIp << ":" << clientPort << std::endl;
+#endif
+	}
 }
 
 void Server::signalHandler(int signal)
@@ -317,7 +821,13 @@ void Server::signalHandler(int signal)
 	{
 	case SIGINT:
 	case SIGTERM:
-		_signalReceived = true;
+		__atomic_store_n(&_signalReceived, signal, __ATOMIC_RELEASE);
+		break;
+	case SIGHUP:
+		__atomic_store_n(&_reloadRequested, 1, __ATOMIC_RELEASE);
+		break;
+	case SIGUSR2:
+		__atomic_store_n(&_upgradeRequested, 1, __ATOMIC_RELEASE);
 		break;
 	case SIGPIPE:
 		// Ignore SIGPIPE - we'll handle broken pipes through send/recv return values
@@ -327,24 +837,57 @@ void Server::signalHandler(int signal)
 
 void Server::handleClientRead(int clientFd)
 {
-	ClientConnection *client = this->_clients[clientFd];
+	ClientConnection *client = this->getClient(clientFd);
 	if (!client)
 		return;
 
 	this->totalRequestsCount++;
 
 	// Read data from the client
-	if (!client->readData())
+	if (!client->readData(_MAX_BYTES_PER_TURN))
 	{									// readData now returns false on EOF or real error
 		markClientForRemoval(clientFd); // Client wants to close or error occurred
 		return;
 	}
 
-	std::string &buffer = const_cast<std::string &>(client->getReadBuffer());
+	// A deferred client is already queued, its requests are served in turn
+	if (!client->isDeferred())
+		this->processBufferedRequests(clientFd);
+}
 
-	// Process multiple requests if pipelined
-	while (client->hasCompleteRequest())
+// Serves the complete requests in the read buffer, pipelined ones in order,
+// until the client's budget for this iteration is spent. Any left over are
+// resumed by processDeferredClients() after every other ready fd had a turn.
+// The responses of the turn are queued and leave together in one write.
+// A client whose queued output reaches the high water mark is paused, it
+// is neither read nor served until handleClientWrite() drains it below
+// the low mark, so a slow reader with a deep pipeline cannot grow memory.
+void Server::processBufferedRequests(int clientFd)
+{
+	ClientConnection *client = this->getClient(clientFd);
+	std::string &buffer = const_cast<std::string &>(client->getReadBuffer());
+	size_t highWater = this->_config->getOutputHighWater();
+	int requests = 0;
+	size_t bytes = 0;
+
+	// Process multiple requests if pipelined, in order: the next one
+	// waits while a handler is suspended
+	while (client->hasCompleteRequest() && !client->isMarkedForRemoval() &&
+		   !client->getPendingResponse() && !client->isReadPaused())
 	{
+		if (highWater > 0 && client->getPendingWriteBytes() >= highWater)
+		{
+			client->setReadPaused(true);
+			this->_backpressurePauses++;
+			break;
+		}
+		if (requests >= _MAX_REQUESTS_PER_TURN || bytes >= _MAX_BYTES_PER_TURN)
+		{
+			client->setDeferred(true);
+			this->_deferredClients.push_back(clientFd);
+			break;
+		}
+
 		// Find end of headers
 		size_t headerEnd = buffer.find("\r\n\r\n");
 		std::string rawRequest = buffer.substr(0, headerEnd + 4);
@@ -361,27 +904,124 @@ void Server::handleClientRead(int clientFd)
 
 		rawRequest = buffer.substr(0, bodyStart + bodyLength);
 		buffer.erase(0, bodyStart + bodyLength); // remove processed request
+		client->startNextRequest();
 
 		// Process the request
-		this->processRequest(clientFd, rawRequest);
+		bytes += rawRequest.size() + this->processRequest(clientFd, rawRequest);
+		requests++;
+
+		// Nothing after a 'Connection: close' request is answered
+		if (!client->isKeepAlive())
+			break;
+	}
+
+	if (client->getPendingWriteBytes() > this->_peakPendingOutput)
+		this->_peakPendingOutput = client->getPendingWriteBytes();
+	if (client->hasDataToWrite())
+		this->scheduleClientWrite(client);
+}
+
+// Writes at once, or under 'write_scheduling srpt' queues the client for
+// flushWriteQueue(), which then updates its interest. Callers skip that
+// update while isWriteQueued().
+void Server::scheduleClientWrite(ClientConnection *client)
+{
+	if (!this->_config->useShortestFirstWrites())
+	{
+		this->handleClientWrite(client->getFd());
+		return;
+	}
+	if (client->isWriteQueued())
+		return;
+	client->setWriteQueued(true);
+	this->_writeQueue.push_back(std::make_pair(client->getPendingWriteBytes(), client->getFd()));
+}
+
+// 'write_scheduling srpt': the writable clients of this iteration, new
+// responses included, are served shortest remaining response first, so
+// small responses are not queued behind bulk downloads, which get a
+// bounded slice each.
+void Server::flushWriteQueue()
+{
+	if (this->_writeQueue.empty())
+		return;
+
+	std::sort(this->_writeQueue.begin(), this->_writeQueue.end());
+	for (size_t i = 0; i < this->_writeQueue.size(); ++i)
+	{
+		int clientFd = this->_writeQueue[i].second;
+		ClientConnection *client = this->getClient(clientFd);
+		if (!client || !client->isWriteQueued())
+			continue;
+		client->setWriteQueued(false);
+		if (client->isMarkedForRemoval())
+			continue;
+
+		this->handleClientWrite(clientFd);
+		client = this->getClient(clientFd);
+		if (client && !client->isMarkedForRemoval())
+		{
+			this->updateClientInterest(client);
+			this->touchClient(client);
+		}
+	}
+	this->_writeQueue.clear();
+}
+
+void Server::processDeferredClients()
+{
+	if (this->_deferredClients.empty())
+		return;
+
+	// Clients deferred again while resuming wait for the next iteration
+	std::vector<int> deferred;
+	deferred.swap(this->_deferredClients);
+	for (size_t i = 0; i < deferred.size(); ++i)
+	{
+		ClientConnection *client = this->getClient(deferred[i]);
+		if (!client || !client->isDeferred())
+			continue;
+		client->setDeferred(false);
+		if (client->isMarkedForRemoval())
+			continue;
+
+		this->processBufferedRequests(deferred[i]);
+		client = this->getClient(deferred[i]);
+		if (client && !client->isMarkedForRemoval() && !client->isWriteQueued())
+		{
+			this->updateClientInterest(client);
+			this->touchClient(client);
+		}
 	}
 }
 
 void Server::handleClientWrite(int clientFd)
 {
-	ClientConnection *client = this->_clients[clientFd];
+	ClientConnection *client = this->getClient(clientFd);
 	if (!client)
 		return;
 
-	// Write data to the client
-	if (!client->writeData())
+	// Write data to the client, bulk transfers in bounded slices when scheduled
+	if (!client->writeData(this->_config->useShortestFirstWrites() ? _BULK_SEND_CHUNK : 0))
 	{									// writeData now returns false on error
 		markClientForRemoval(clientFd); // Error occurred during write
 		return;
 	}
 
-	// If all data is written, potentially transition state or prepare for next request
-	if (!client->hasDataToWrite())
+	// Drained below the low water mark: the buffered requests are served next iteration
+	if (client->isReadPaused() && client->getPendingWriteBytes() <= this->_config->getOutputLowWater())
+	{
+		client->setReadPaused(false);
+		if (client->hasCompleteRequest() && !client->isDeferred())
+		{
+			client->setDeferred(true);
+			this->_deferredClients.push_back(clientFd);
+		}
+	}
+
+	// If all data is written, potentially transition state or prepare for next
+	// request. A suspended handler keeps the client until its response is queued.
+	if (!client->hasDataToWrite() && !client->getPendingResponse())
 	{
 		// Example: If not keep-alive, close connection, otherwise reset for next request
 		if (!client->isKeepAlive())
@@ -390,55 +1030,163 @@ void Server::handleClientWrite(int clientFd)
 		}
 		else
 		{
-			// Reset client for next request in keep-alive scenario
-			client->setState(CONN_READING_REQUEST);
-			FD_CLR(clientFd, &_masterWriteFds); // Stop monitoring for write readiness
-			FD_SET(clientFd, &_masterReadFds);	// Start monitoring for read readiness
+			// Reset client for next request in keep-alive scenario, idle unless
+			// part of a pipelined request is already buffered
+			client->setState(client->getReadBuffer().empty() ? CONN_KEEP_ALIVE : CONN_READING_REQUEST);
 			client->setContentLength(0);
 		}
 	}
 }
 
+// Re-arms the client's deadline for the phase it is in, O(1)
+void Server::touchClient(ClientConnection *client)
+{
+	const ConnectionTimeouts &timeouts = this->_config->getTimeouts();
+	unsigned long now = TimerWheel::getMonotonicMillis();
+	unsigned long deadline;
+
+	// Idle order is the order clients entered keep-alive, a touch keeps it
+	if (client->getState() != CONN_KEEP_ALIVE)
+		this->_idleClients.remove(client->getIdleNode());
+	else if (!client->getIdleNode().isLinked())
+		this->_idleClients.pushBack(client->getIdleNode());
+
+	switch (client->getState())
+	{
+	case CONN_KEEP_ALIVE:
+		deadline = now + this->getKeepAliveTimeoutMs();
+		break;
+	case CONN_WRITING_RESPONSE:
+		deadline = client->getLastWriteAt() + timeouts.send * 1000UL;
+		break;
+	case CONN_PROCESSING_REQUEST:
+		// Wakes the suspended handler, which enforces its own time limit
+		deadline = client->getPendingResponse()->response->getDeadline(now);
+		break;
+	default:
+		if (!client->isReadingBody())
+			// Fixed from the first byte, trickling the head does not extend it
+			deadline = client->getRequestStartedAt() + timeouts.header * 1000UL;
+		else if (timeouts.body_min_rate == 0)
+			deadline = now + timeouts.body * 1000UL;
+		else
+			// Each body byte received buys 1/body_min_rate seconds
+			deadline = client->getBodyStartedAt() + timeouts.body * 1000UL +
+					   client->getBodyBytesRead() * 1000UL / timeouts.body_min_rate;
+		break;
+	}
+	this->_timers.schedule(client->getTimerNode(), deadline);
+}
+
+// Shrinks from the configured timeout down to a second as fd headroom
+// falls from twice the low-water mark towards zero
+unsigned long Server::getKeepAliveTimeoutMs() const
+{
+	unsigned long timeoutMs = this->_config->getTimeouts().keepalive * 1000UL;
+	int headroom = this->_admission->getFdHeadroom();
+	if (headroom >= 2 * this->_fdLowWater)
+		return timeoutMs;
+	return std::max(1000UL, timeoutMs * std::max(headroom, 0) / (2 * this->_fdLowWater));
+}
+
+// Marks up to count of the longest idle keep-alive clients for removal
+size_t Server::evictIdleClients(size_t count)
+{
+	size_t evicted = 0;
+	while (evicted < count && this->_idleClients.size() > 0)
+	{
+		int clientFd = this->_idleClients.front();
+		ClientConnection *client = this->getClient(clientFd);
+		this->_idleClients.remove(client->getIdleNode());
+		if (client->isMarkedForRemoval())
+			continue;
+		this->markClientForRemoval(clientFd);
+		evicted++;
+	}
+	return evicted;
+}
+
+// Run once per iteration by every loop holding clients
+void Server::relieveFdPressure()
+{
+	int headroom = this->_admission->getFdHeadroom();
+	if (headroom >= this->_fdLowWater || this->_dispatcher)
+		return;
+
+	size_t evicted = this->evictIdleClients(this->_fdLowWater - headroom);
+	if (evicted > 0)
+	{
+		// Credited now so other loops do not evict for the same shortfall
+		this->_admission->addFdHeadroom(evicted);
+		std::cout << "Fd pressure: evicted " << evicted << " idle keep-alive connection(s)" << std::endl;
+	}
+}
+
+// Frees the reserved fd for long enough to accept and refuse one connection
+void Server::refuseWithSpareFd(int listenFd)
+{
+	if (this->_spareFd < 0)
+	{
+		logError("accept() failed on listenFd " + toString(listenFd) + ": " + strerror(EMFILE));
+		return;
+	}
+	close(this->_spareFd);
+	int clientFd = accept(listenFd, NULL, NULL);
+	if (clientFd >= 0)
+	{
+		send(clientFd, SERVICE_UNAVAILABLE_RESPONSE.c_str(), SERVICE_UNAVAILABLE_RESPONSE.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+		close(clientFd);
+	}
+	this->_spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+// Costs O(expired), only clients whose deadline passed are visited
 void Server::cleanupTimedOutClients()
 {
-	// time_t currentTime = time(NULL);
 	std::vector<int> timedOutClients;
+	this->_timers.advance(TimerWheel::getMonotonicMillis(), timedOutClients);
 
-	for (std::map<int, ClientConnection *>::iterator it = _clients.begin(); it != _clients.end(); ++it)
+	for (size_t i = 0; i < timedOutClients.size(); ++i)
 	{
-		if (it->second->isTimedOut(_TIMEOUT_SECONDS) && !this->isAlreadyMarkedForRemoval(it->first))
+		ClientConnection *client = this->getClient(timedOutClients[i]);
+		if (!client)
+			continue;
+		if (client->getPendingResponse())
 		{
-			timedOutClients.push_back(it->first);
+			this->resumePendingResponse(timedOutClients[i]);
+			continue;
 		}
-	}
 
-	for (size_t i = 0; i < timedOutClients.size(); ++i)
-	{
+		// Best effort: a client too slow to send its request is told why
+		if (client->getState() == CONN_READING_REQUEST)
+			send(client->getFd(), REQUEST_TIMEOUT_RESPONSE.c_str(), REQUEST_TIMEOUT_RESPONSE.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
 		markClientForRemoval(timedOutClients[i]);
 	}
 }
 
 bool Server::isAlreadyMarkedForRemoval(int clientFd)
 {
-	return std::find(this->_clientsToRemove.begin(), this->_clientsToRemove.end(), clientFd) != this->_clientsToRemove.end();
+	ClientConnection *client = this->getClient(clientFd);
+	return client && client->isMarkedForRemoval();
 }
 
 void Server::removeClient(int clientFd)
 {
-	std::map<int, ClientConnection *>::iterator it;
-	it = this->_clients.find(clientFd);
-
-	if (it == this->_clients.end())
+	ClientConnection *client = this->getClient(clientFd);
+	if (!client)
 		return;
 
-	// Remove from master fd_sets
-	FD_CLR(clientFd, &_masterReadFds);
-	FD_CLR(clientFd, &_masterWriteFds);
-	FD_CLR(clientFd, &_exceptFds); // Also clear from except set if used
-
-	delete it->second;		  // Delete the ClientConnection object
-	this->_clients.erase(it); // Remove from map
-	close(clientFd);		  // Close the socket FD
+	// Must happen before close() so the backend never sees a stale or reused fd
+	if (client->getPendingResponse())
+		this->releasePendingResponse(client);
+	this->_poller->remove(clientFd);
+	this->_timers.cancel(client->getTimerNode());
+	this->_idleClients.remove(client->getIdleNode());
+
+	this->_clients[clientFd] = NULL;
+	this->_clientCount--;
+	this->_admission->release(client->getAdmissionTicket());
+	this->_pool.release(client); // Closes the socket FD
 }
 
 void Server::logError(const std::string &message)
@@ -470,93 +1218,223 @@ void Server::processClientRemovalQueue()
 }
 
 // I/O Multiplexing helpers
-void Server::setupFdSets()
+bool Server::registerFd(int fd, unsigned int events)
 {
-	// Clear All Sets
-	FD_ZERO(&this->_readFds);
-	FD_ZERO(&this->_writeFds);
-	FD_ZERO(&this->_exceptFds);
-
-	// Always Monitor Server Sockets for New Connections
-	std::map<int, const ServerConfig *>::iterator sit;
-	for (sit = this->_listeningSockets.begin(); sit != this->_listeningSockets.end(); sit++)
+	if (!this->_poller->add(fd, events))
 	{
-		int serverFd = sit->first;
-		FD_SET(serverFd, &this->_readFds);
-		this->_maxFd = serverFd;
+		logError(std::string(this->_poller->getName()) + ": cannot register fd " + toString(fd) + ": " + strerror(errno));
+		return false;
 	}
+	return true;
+}
 
-	// Add Client Sockets
-	std::map<int, ClientConnection *>::iterator it;
+// Updates the poller only when the wanted events differ from the registered ones,
+// so steady-state connections cost no syscalls beyond the wait itself.
+void Server::updateClientInterest(ClientConnection *client)
+{
+	unsigned int wanted = 0;
+	if (client->needsRead())
+		wanted |= POLLER_READ;
+	if (client->needsWrite())
+		wanted |= POLLER_WRITE;
+
+	// A suspended CGI request with nothing queued wants no events at all,
+	// so an empty mask does not mean the fd was never registered
+	unsigned int current = client->getPollEvents();
+	if (client->isPollRegistered() && wanted == current)
+		return;
 
-	// Add client sockets
-	for (it = this->_clients.begin(); it != this->_clients.end(); it++)
+	int fd = client->getFd();
+	if (!client->isPollRegistered())
+	{
+		// First registration: always watch for input so peer hangups are noticed
+		wanted |= POLLER_READ;
+		if (!this->registerFd(fd, wanted))
+			return;
+		client->setPollRegistered(true);
+	}
+	else if (!this->_poller->modify(fd, wanted))
 	{
-		int clientFd = it->first;
-		ClientConnection *client = it->second;
+		logError(std::string(this->_poller->getName()) + ": cannot modify fd " + toString(fd) + ": " + strerror(errno));
+		markClientForRemoval(fd);
+		return;
+	}
+	client->setPollEvents(wanted);
+}
 
-		if (client->needsRead())
-			FD_SET(clientFd, &this->_readFds);
+void Server::processEvents()
+{
+	for (size_t i = 0; i < this->_events.size(); ++i)
+	{
+		int fd = this->_events[i].fd;
+		unsigned int events = this->_events[i].events;
 
-		if (client->needsWrite())
-			FD_SET(clientFd, &this->_writeFds);
+		// Clients first: one indexed load on the hot path
+		ClientConnection *client = this->getClient(fd);
+		if (!client)
+		{
+			if (this->_listeningSockets.count(fd))
+				handleNewConnection(fd);
+			else if (this->_handoffQueue && fd == this->_handoffQueue->getWakeFd())
+				this->drainHandoffQueue();
+			else if (this->_pipeClients.count(fd))
+				this->resumePendingResponse(this->_pipeClients[fd]);
+			continue;
+		}
+		if (client->isMarkedForRemoval())
+			continue;
+
+		// Nothing is read while a handler is suspended, a reset peer is only
+		// noticed here and would otherwise be reported again every wait()
+		if ((events & POLLER_ERROR) && client->getPendingResponse())
+		{
+			markClientForRemoval(fd);
+			continue;
+		}
 
-		// Always monitor for exceptions
-		FD_SET(clientFd, &this->_exceptFds);
+		// Errors and hangups surface through recv()/send() return values
+		if ((events & (POLLER_READ | POLLER_ERROR)) && client->needsRead())
+			handleClientRead(fd);
+		if ((events & (POLLER_WRITE | POLLER_ERROR)) && client->needsWrite())
+			this->scheduleClientWrite(client);
 
-		if (clientFd > this->_maxFd)
-			this->_maxFd = clientFd;
+		// The client may have been removed or changed state while being served,
+		// a queued one is updated by flushWriteQueue() once every ready fd is known
+		client = this->getClient(fd);
+		if (client && !client->isMarkedForRemoval() && !client->isWriteQueued())
+		{
+			this->updateClientInterest(client);
+			this->touchClient(client);
+		}
 	}
 }
 
-void Server::processFdSets()
+// Adopts the connections the acceptor thread queued for this loop
+void Server::drainHandoffQueue()
 {
-	for (int fd = 0; fd <= _maxFd; ++fd)
+	this->_handoffQueue->drainWakeFd();
+
+	HandoffQueue::Item item;
+	while (this->_handoffQueue->pop(item))
 	{
-		// Check for activity on listening sockets
-		if (FD_ISSET(fd, &_readFds))
+		if (item.fd == HandoffQueue::STOP)
 		{
-			if (_listeningSockets.count(fd)) // Is it a listening socket?
-			{
-				handleNewConnection(fd);
-				continue; // Move to next FD
-			}
+			this->_running = false; // Stop request from the reactor
+			continue;
 		}
-
-		// Check for activity on client sockets
-		// Ensure it's a known client AND it's not already marked for removal
-		if (_clients.count(fd))
+		if (item.fd == HandoffQueue::DRAIN)
 		{
-			// Check if client needs to be read from
-			if (FD_ISSET(fd, &_readFds) && _clients[fd]->needsRead())
-			{
-				handleClientRead(fd);
-			}
-			// Check if client needs to be written to
-			if (FD_ISSET(fd, &_writeFds) && _clients[fd]->needsWrite())
-			{
-				handleClientWrite(fd);
-			}
+			this->drain();
+			continue;
+		}
+		if (!addClient(item.fd))
+		{
+			logError("Failed to add client " + toString(item.fd));
+			this->_admission->release(item.admission);
+			continue;
 		}
+		this->_clients[item.fd]->setClientInfo(item.ip, item.port);
+		this->_clients[item.fd]->setAdmissionTicket(item.admission);
+
+		// The acceptor's listener, found again from the connection's own address
+		if (strcmp(item.ip, UnixSocket::PREFIX) == 0)
+			this->_clients[item.fd]->setUnixListener(UnixSocket::PREFIX + UnixSocket::getBoundPath(item.fd));
 	}
 }
 
+// The only place the loop counters are reported: there is no status
+// endpoint, so each event loop prints its own totals when it exits
+void Server::printLoopStatistics() const
+{
+	if (!this->_poller || this->_loopIterations == 0)
+		return;
+
+	std::cout << "Event loop (" << this->_poller->getName() << "): "
+			  << this->_loopIterations << " iterations, "
+			  << (this->_loopCpuMicros / this->_loopIterations) << " us CPU per iteration" << std::endl;
+	if (this->_config->getOutputHighWater() > 0)
+		std::cout << "Output backpressure: water marks " << this->_config->getOutputHighWater() << "/"
+				  << this->_config->getOutputLowWater() << " bytes, " << this->_backpressurePauses
+				  << " pauses, peak " << this->_peakPendingOutput << " bytes queued for one client" << std::endl;
+}
+
 void Server::shutdown()
 {
 	this->_shutdownRequested = true;
 }
 
-void Server::processRequest(int clientFd, const std::string &rawRequest)
+// Stops accepting, closes idle connections and lets the others finish their
+// current response with 'Connection: close'; run() returns once none are left
+// or the shutdown timeout expires.
+void Server::drain()
 {
-	ClientConnection *client = this->_clients[clientFd];
-	if (!client)
+	if (this->_draining)
 		return;
+	this->_draining = true;
+	this->_drainDeadline = TimerWheel::getMonotonicMillis() + this->_config->getShutdownTimeout() * 1000UL;
+
+	this->closeListeners();
+	for (size_t fd = 0; fd < this->_clients.size(); ++fd)
+	{
+		ClientConnection *client = this->_clients[fd];
+		if (!client)
+			continue;
+		client->setKeepAlive(false);
+		if (this->isIdle(client))
+			this->markClientForRemoval(fd);
+	}
+	this->processClientRemovalQueue();
+	std::cout << "Draining " << this->_clientCount << " connection(s)" << std::endl;
+}
+
+bool Server::isDraining() const
+{
+	return this->_draining;
+}
+
+// True once a drain has nothing left to wait for
+bool Server::isDrained() const
+{
+	if (this->_clientCount == 0)
+		return true;
+	if (TimerWheel::getMonotonicMillis() < this->_drainDeadline)
+		return false;
+	std::cout << "Shutdown timeout reached, closing " << this->_clientCount << " connection(s)" << std::endl;
+	return true;
+}
+
+void Server::closeListeners()
+{
+	std::map<int, const ServerConfig *>::iterator it;
+	for (it = this->_listeningSockets.begin(); it != this->_listeningSockets.end(); ++it)
+	{
+		this->_poller->remove(it->first);
+		close(it->first);
+	}
+	this->_listeningSockets.clear();
+}
+
+// Between requests, nothing of the next one received yet
+bool Server::isIdle(const ClientConnection *client) const
+{
+	if (client->getState() == CONN_KEEP_ALIVE)
+		return true;
+	return client->getState() == CONN_READING_REQUEST && client->getReadBuffer().empty();
+}
+
+// Returns the size of the response queued
+size_t Server::processRequest(int clientFd, const std::string &rawRequest)
+{
+	ClientConnection *client = this->getClient(clientFd);
+	if (!client)
+		return 0;
 
 	// Get current time for logging
 	time_t now = time(NULL);
 	char timeBuffer[80];
-	struct tm *timeInfo = localtime(&now);
-	strftime(timeBuffer, sizeof(timeBuffer), "%Y-%m-%d %H:%M:%S", timeInfo);
+	struct tm timeInfo;
+	localtime_r(&now, &timeInfo);
+	strftime(timeBuffer, sizeof(timeBuffer), "%Y-%m-%d %H:%M:%S", &timeInfo);
 
 	// std::cout << "\n\n--------------------------" << std::endl;
 	// std::cout << "Current time: " << timeBuffer << std::endl;
@@ -564,18 +1442,147 @@ void Server::processRequest(int clientFd, const std::string &rawRequest)
 	// std::cout << rawRequest << std::endl;
 	// std::cout << "--------------------------" << std::endl;
 
-	Request request(rawRequest);
-	std::cout << request.toString() << std::endl;
-
-	// Keep-Alive handling
-	if (!request.getHeaderValues("connection").empty())
+	Request *request = new Request(rawRequest);
+	std::cout << request->toString() << std::endl;
+
+	// Keep-Alive handling: HTTP/1.1 connections persist unless the client
+	// asks to close, HTTP/1.0 ones only when it asks to keep alive, up to
+	// keepalive_requests. Whatever follows a request that failed to parse
+	// cannot be trusted, and a draining server answers what it has, then
+	// closes.
+	client->incrementRequestCount();
+	int maxRequests = this->_config->getKeepaliveRequests();
+	bool persistent;
+	if (!request->isValid())
+		persistent = false;
+	else if (request->getVersion() == "HTTP/1.1")
+		persistent = !request->hasConnectionOption("close");
+	else
+		persistent = request->hasConnectionOption("keep-alive");
+	client->setKeepAlive(!this->_draining && persistent &&
+						 (maxRequests == 0 || client->getRequestCount() < maxRequests));
+
+	Response *response = new Response(*this->_config, *request, *client);
+	if (!response->isReady())
 	{
-		client->setKeepAlive(
-			request.getHeaderValues("connection")[0].find("keep-alive") != std::string::npos);
+		// Suspended: the client waits in CONN_PROCESSING_REQUEST, the loop
+		// serves the others and resumes it through resumePendingResponse()
+		PendingResponse *pending = new PendingResponse();
+		pending->snapshot = this->_configStore.retain(this->_snapshot);
+		pending->request = request;
+		pending->response = response;
+		pending->watchedInputFd = -1;
+		pending->watchedOutputFd = -1;
+		client->setPendingResponse(pending);
+		client->setState(CONN_PROCESSING_REQUEST);
+		this->watchPendingResponse(client);
+		return 0;
 	}
 
+	size_t size = this->queueResponse(client, *response);
+	delete response;
+	delete request;
+	return size;
+}
+
+// Queued behind the client's earlier responses, the caller writes them out
+size_t Server::queueResponse(ClientConnection *client, const Response &response)
+{
+	if (response.closesConnection())
+		client->setKeepAlive(false);
 	client->setState(CONN_WRITING_RESPONSE);
-	Response response(this->_configManager, request);
-	client->appendToWriteBuffer(response.get());
-	this->handleClientWrite(client->getFd());
+	std::string content = response.get();
+	size_t size = content.size();
+	client->queueResponse(content);
+	return size;
+}
+
+// Called when one of the client's CGI pipes is ready or its deadline passed
+void Server::resumePendingResponse(int clientFd)
+{
+	ClientConnection *client = this->getClient(clientFd);
+	if (!client || !client->getPendingResponse() || client->isMarkedForRemoval())
+		return;
+
+	Response *response = client->getPendingResponse()->response;
+	response->resume(TimerWheel::getMonotonicMillis());
+	if (!response->isReady())
+	{
+		this->watchPendingResponse(client);
+		this->touchClient(client);
+		return;
+	}
+
+	this->queueResponse(client, *response);
+	this->releasePendingResponse(client);
+	this->scheduleClientWrite(client);
+	client = this->getClient(clientFd);
+	if (!client || client->isMarkedForRemoval())
+		return;
+
+	// Pipelined requests that arrived meanwhile are served next iteration
+	if (client->hasCompleteRequest() && !client->isDeferred())
+	{
+		client->setDeferred(true);
+		this->_deferredClients.push_back(clientFd);
+	}
+	if (client->isWriteQueued())
+		return;
+	this->updateClientInterest(client);
+	this->touchClient(client);
+}
+
+// Registers the pipes the suspended handler waits on and closes the
+// ones it is done with, unregistered first like any other fd
+void Server::watchPendingResponse(ClientConnection *client)
+{
+	PendingResponse *pending = client->getPendingResponse();
+	CGIHandler::Process &cgi = pending->response->getCGIProcess();
+
+	this->watchPipe(client->getFd(), pending->watchedInputFd, cgi.inputFd,
+					CGIHandler::getWaitingInputFd(cgi), POLLER_WRITE);
+	this->watchPipe(client->getFd(), pending->watchedOutputFd, cgi.outputFd,
+					CGIHandler::getWaitingOutputFd(cgi), POLLER_READ);
+}
+
+void Server::watchPipe(int clientFd, int &watchedFd, int &pipeFd, int waitingFd, unsigned int events)
+{
+	if (watchedFd >= 0 && watchedFd != waitingFd)
+	{
+		this->_poller->remove(watchedFd);
+		this->_pipeClients.erase(watchedFd);
+		watchedFd = -1;
+	}
+	if (waitingFd < 0)
+	{
+		CGIHandler::closePipe(pipeFd);
+		return;
+	}
+	// Left to the handler's deadline if it cannot be watched
+	if (watchedFd < 0 && this->registerFd(waitingFd, events))
+	{
+		watchedFd = waitingFd;
+		this->_pipeClients[waitingFd] = clientFd;
+	}
+}
+
+// Unregisters the pipes, then frees the handler, which kills a script
+// still running when the client went away first
+void Server::releasePendingResponse(ClientConnection *client)
+{
+	PendingResponse *pending = client->getPendingResponse();
+	int fds[2] = {pending->watchedInputFd, pending->watchedOutputFd};
+	for (int i = 0; i < 2; ++i)
+	{
+		if (fds[i] < 0)
+			continue;
+		this->_poller->remove(fds[i]);
+		this->_pipeClients.erase(fds[i]);
+	}
+
+	delete pending->response;
+	delete pending->request;
+	this->_configStore.release(pending->snapshot);
+	delete pending;
+	client->setPendingResponse(NULL);
 }
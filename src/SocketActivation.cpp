@@ -0,0 +1,44 @@
+#include <SocketActivation.hpp>
+#include <iostream>
+#include <cstdlib>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+namespace SocketActivation
+{
+	static const int LISTEN_FDS_START = 3;
+
+	int takeListeners(std::vector<int> &listenFds)
+	{
+		const char *pidValue = getenv("LISTEN_PID");
+		const char *countValue = getenv("LISTEN_FDS");
+		if (!pidValue || !countValue)
+			return 0;
+
+		// Meant for another process, e.g. a wrapper that exec'd us after forking
+		int count = std::atoi(countValue);
+		bool forUs = (std::atoi(pidValue) == getpid());
+		unsetenv("LISTEN_PID");
+		unsetenv("LISTEN_FDS");
+		unsetenv("LISTEN_FDNAMES");
+		if (!forUs || count <= 0)
+			return 0;
+
+		int taken = 0;
+		for (int fd = LISTEN_FDS_START; fd < LISTEN_FDS_START + count; ++fd)
+		{
+			int type;
+			socklen_t length = sizeof(type);
+			if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &length) < 0 || type != SOCK_STREAM)
+			{
+				std::cerr << "Warning: LISTEN_FDS: fd " << fd << " is not a stream socket, ignored" << std::endl;
+				continue;
+			}
+			fcntl(fd, F_SETFD, FD_CLOEXEC); // Not for CGI children
+			listenFds.push_back(fd);
+			++taken;
+		}
+		return taken;
+	}
+}
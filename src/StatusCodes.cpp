@@ -22,6 +22,8 @@ namespace StatusCodes
 			return "Not Found";
 		case METHOD_NOT_ALLOWED:
 			return "Method Not Allowed";
+		case REQUEST_TIMEOUT:
+			return "Request Timeout";
 		case CONFLICT:
 			return "Conflict";
 		case PAYLOAD_TOO_LARGE:
@@ -30,6 +32,8 @@ namespace StatusCodes
 			return "Internal Server Error";
 		case NOT_IMPLEMENTED:
 			return "Not Implemented";
+		case SERVICE_UNAVAILABLE:
+			return "Service Unavailable";
 		case GATEWAY_ERROR:
 			return "Gateway Timeout";
 		default:
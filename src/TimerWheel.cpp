@@ -0,0 +1,197 @@
+#include <TimerWheel.hpp>
+
+const unsigned long TimerWheel::TICK_MS;
+const int TimerWheel::_LEVELS;
+const int TimerWheel::_LEVEL0_BITS;
+const int TimerWheel::_LEVELN_BITS;
+
+TimerWheel::Node::Node() : prev(NULL), next(NULL), expiry(0), fd(-1) {}
+
+bool TimerWheel::Node::isLinked() const
+{
+	return this->next != NULL;
+}
+
+TimerWheel::TimerWheel(unsigned long nowMs) : _currentTick(nowMs / TICK_MS), _count(0)
+{
+	for (int level = 0; level < _LEVELS; ++level)
+	{
+		this->_slots[level].resize(getLevelSize(level));
+		for (size_t i = 0; i < this->_slots[level].size(); ++i)
+		{
+			Node &head = this->_slots[level][i];
+			head.prev = &head;
+			head.next = &head;
+		}
+	}
+}
+
+TimerWheel::~TimerWheel()
+{
+	// Leave the owners' nodes in a consistent, unlinked state
+	for (int level = 0; level < _LEVELS; ++level)
+	{
+		for (size_t i = 0; i < this->_slots[level].size(); ++i)
+		{
+			Node &head = this->_slots[level][i];
+			while (head.next != &head)
+				unlink(*head.next);
+		}
+	}
+}
+
+int TimerWheel::getLevelShift(int level)
+{
+	return level == 0 ? 0 : _LEVEL0_BITS + (level - 1) * _LEVELN_BITS;
+}
+
+size_t TimerWheel::getLevelSize(int level)
+{
+	return level == 0 ? (1UL << _LEVEL0_BITS) : (1UL << _LEVELN_BITS);
+}
+
+void TimerWheel::link(Node &node)
+{
+	unsigned long tick = node.expiry;
+	if (tick <= this->_currentTick)
+		tick = this->_currentTick + 1; // Never link into the slot being processed
+
+	// Lowest level where the expiry falls within the current lap
+	int level = 0;
+	while (level < _LEVELS &&
+		   (tick >> getLevelShift(level)) - (this->_currentTick >> getLevelShift(level)) >= getLevelSize(level))
+		level++;
+
+	// Beyond the wheel's range: park in the farthest slot, advance() re-links it
+	if (level == _LEVELS)
+	{
+		level = _LEVELS - 1;
+		tick = ((this->_currentTick >> getLevelShift(level)) + getLevelSize(level) - 1) << getLevelShift(level);
+	}
+
+	size_t index = (tick >> getLevelShift(level)) & (getLevelSize(level) - 1);
+	Node &head = this->_slots[level][index];
+	node.prev = head.prev;
+	node.next = &head;
+	head.prev->next = &node;
+	head.prev = &node;
+}
+
+void TimerWheel::unlink(Node &node)
+{
+	node.prev->next = node.next;
+	node.next->prev = node.prev;
+	node.prev = NULL;
+	node.next = NULL;
+}
+
+void TimerWheel::schedule(Node &node, unsigned long deadlineMs)
+{
+	if (node.isLinked())
+		unlink(node);
+	else
+		this->_count++;
+	node.expiry = (deadlineMs + TICK_MS - 1) / TICK_MS;
+	this->link(node);
+}
+
+void TimerWheel::cancel(Node &node)
+{
+	if (!node.isLinked())
+		return;
+	unlink(node);
+	this->_count--;
+}
+
+// Moves the timers of the current slot at level down to the lower levels
+void TimerWheel::cascade(int level)
+{
+	size_t index = (this->_currentTick >> getLevelShift(level)) & (getLevelSize(level) - 1);
+	Node &head = this->_slots[level][index];
+	while (head.next != &head)
+	{
+		Node &node = *head.next;
+		unlink(node);
+		this->link(node);
+	}
+}
+
+void TimerWheel::advance(unsigned long nowMs, std::vector<int> &expired)
+{
+	unsigned long nowTick = nowMs / TICK_MS;
+
+	// Nothing armed: jump instead of stepping through every idle tick
+	if (this->_count == 0)
+	{
+		if (nowTick > this->_currentTick)
+			this->_currentTick = nowTick;
+		return;
+	}
+
+	while (this->_currentTick < nowTick)
+	{
+		this->_currentTick++;
+
+		// Entering a new lap of a lower level pulls the matching upper slot down
+		for (int level = 1; level < _LEVELS; ++level)
+		{
+			if ((this->_currentTick & ((1UL << getLevelShift(level)) - 1)) != 0)
+				break;
+			this->cascade(level);
+		}
+
+		Node &head = this->_slots[0][this->_currentTick & (getLevelSize(0) - 1)];
+		while (head.next != &head)
+		{
+			Node &node = *head.next;
+			unlink(node);
+			if (node.expiry > this->_currentTick)
+			{
+				this->link(node); // Clamped timer that is not due yet
+				continue;
+			}
+			this->_count--;
+			expired.push_back(node.fd);
+		}
+
+		if (this->_count == 0)
+		{
+			this->_currentTick = nowTick;
+			break;
+		}
+	}
+}
+
+long TimerWheel::getNextTimeoutMs(unsigned long nowMs) const
+{
+	if (this->_count == 0)
+		return -1;
+
+	// First non-empty slot in the rest of the level 0 lap
+	size_t size0 = getLevelSize(0);
+	unsigned long tick = this->_currentTick + 1;
+	for (; (tick & (size0 - 1)) != 0; ++tick)
+	{
+		const Node &head = this->_slots[0][tick & (size0 - 1)];
+		if (head.next != &head)
+			break;
+	}
+	// Otherwise wake up at the next lap boundary, where the next cascade happens
+
+	unsigned long deadlineMs = tick * TICK_MS;
+	if (deadlineMs <= nowMs)
+		return 0;
+	return static_cast<long>(deadlineMs - nowMs);
+}
+
+size_t TimerWheel::size() const
+{
+	return this->_count;
+}
+
+unsigned long TimerWheel::getMonotonicMillis()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
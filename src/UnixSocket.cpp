@@ -0,0 +1,72 @@
+#include <UnixSocket.hpp>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+namespace UnixSocket
+{
+	static bool makeAddress(const std::string &path, struct sockaddr_un &address)
+	{
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (path.empty() || path.length() >= sizeof(address.sun_path))
+		{
+			errno = ENAMETOOLONG;
+			return false;
+		}
+		memcpy(address.sun_path, path.c_str(), path.length());
+		return true;
+	}
+
+	// A socket file nobody accepts on any more, e.g. after a crash
+	static bool isStale(const struct sockaddr_un &address)
+	{
+		struct stat st;
+		if (stat(address.sun_path, &st) != 0 || !S_ISSOCK(st.st_mode))
+			return false;
+
+		int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (probe < 0)
+			return false;
+		bool stale = (connect(probe, (const struct sockaddr *)&address, sizeof(address)) < 0 && errno == ECONNREFUSED);
+		close(probe);
+		return stale;
+	}
+
+	int listen(const std::string &path, int backlog)
+	{
+		struct sockaddr_un address;
+		if (!makeAddress(path, address))
+			return -1;
+
+		int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (listenFd < 0)
+			return -1;
+
+		if (isStale(address))
+			unlink(address.sun_path);
+		if (bind(listenFd, (const struct sockaddr *)&address, sizeof(address)) < 0 ||
+			::listen(listenFd, backlog) < 0)
+		{
+			int savedErrno = errno;
+			close(listenFd);
+			errno = savedErrno;
+			return -1;
+		}
+		return listenFd;
+	}
+
+	std::string getBoundPath(int fd)
+	{
+		struct sockaddr_un address;
+		socklen_t length = sizeof(address);
+		memset(&address, 0, sizeof(address));
+		if (getsockname(fd, (struct sockaddr *)&address, &length) < 0 || address.sun_family != AF_UNIX)
+			return "";
+		return std::string(address.sun_path, strnlen(address.sun_path, sizeof(address.sun_path)));
+	}
+}
@@ -0,0 +1,145 @@
+#include <Upgrade.hpp>
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/resource.h>
+
+extern char **environ;
+
+namespace Upgrade
+{
+	static const char *const ENV_NAME = "WEBSERV_UPGRADE";
+
+	static std::vector<std::string> commandLine;
+	static std::string executable; // Path handed to execve(), see saveCommandLine()
+	static pid_t oldPid = -1; // Set in the new binary until notifyReady()
+
+	void saveCommandLine(int argc, char *argv[])
+	{
+		commandLine.assign(argv, argv + argc);
+
+		// execve() does not search PATH: a binary started by name is found
+		// through /proc/self/exe. An explicit path is kept as given, so a
+		// symlink switched to a new release is followed.
+		if (argc > 0 && std::strchr(argv[0], '/'))
+			executable = argv[0];
+		else
+		{
+			char path[PATH_MAX];
+			ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+			if (len > 0)
+				executable.assign(path, len);
+		}
+	}
+
+	// Child side, between fork() and exec(): leave nothing else open
+	static void closeOtherFds(const std::vector<int> &keep)
+	{
+		struct rlimit rl;
+		int maxFd = 1024;
+		if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+			maxFd = static_cast<int>(rl.rlim_cur);
+
+		for (int fd = 3; fd < maxFd; ++fd)
+		{
+			bool inherited = false;
+			for (size_t i = 0; i < keep.size() && !inherited; ++i)
+				inherited = (keep[i] == fd);
+			if (inherited)
+				fcntl(fd, F_SETFD, 0); // Clear FD_CLOEXEC
+			else
+				close(fd);
+		}
+	}
+
+	pid_t spawn(const std::vector<int> &listenFds)
+	{
+		if (executable.empty())
+		{
+			errno = ENOENT;
+			return -1;
+		}
+
+		std::ostringstream value;
+		value << ENV_NAME << "=" << getpid() << ";";
+		for (size_t i = 0; i < listenFds.size(); ++i)
+			value << listenFds[i] << ";";
+		std::string variable = value.str();
+
+		// Everything exec needs is built before fork(): the parent may be
+		// threaded, so the child must not allocate
+		std::vector<char *> argv;
+		for (size_t i = 0; i < commandLine.size(); ++i)
+			argv.push_back(const_cast<char *>(commandLine[i].c_str()));
+		argv.push_back(NULL);
+
+		std::vector<char *> envp;
+		for (char **env = environ; *env; ++env)
+			envp.push_back(*env);
+		envp.push_back(const_cast<char *>(variable.c_str()));
+		envp.push_back(NULL);
+
+		pid_t pid = fork();
+		if (pid != 0)
+			return pid;
+
+		// Handlers are reset by exec, the blocked mask is not
+		sigset_t none;
+		sigemptyset(&none);
+		sigprocmask(SIG_SETMASK, &none, NULL);
+
+		closeOtherFds(listenFds);
+		execve(executable.c_str(), &argv[0], &envp[0]);
+
+		static const char message[] = "Error: Upgrade: cannot execute the new binary\n";
+		ssize_t ret = write(STDERR_FILENO, message, sizeof(message) - 1);
+		(void)ret;
+		_exit(127);
+	}
+
+	bool takeInheritedListeners(std::vector<int> &listenFds)
+	{
+		const char *value = getenv(ENV_NAME);
+		if (!value)
+			return false;
+
+		std::istringstream fields(value);
+		std::string field;
+		if (std::getline(fields, field, ';'))
+			oldPid = std::atoi(field.c_str());
+		while (std::getline(fields, field, ';'))
+		{
+			if (!field.empty())
+				listenFds.push_back(std::atoi(field.c_str()));
+		}
+
+		// Not meant for CGI children or a later upgrade
+		unsetenv(ENV_NAME);
+		return true;
+	}
+
+	void notifyReady()
+	{
+		if (oldPid <= 0)
+			return;
+		std::cout << "Upgrade complete, asking old process " << oldPid << " to drain" << std::endl;
+		kill(oldPid, SIGTERM);
+		oldPid = -1;
+	}
+
+	void reportReady(int readyFd)
+	{
+		if (readyFd < 0)
+			return;
+		char byte = 1;
+		while (write(readyFd, &byte, 1) < 0 && errno == EINTR)
+			;
+		close(readyFd);
+	}
+}
@@ -0,0 +1,693 @@
+#include <UringPoller.hpp>
+
+#ifdef WEBSERV_HAVE_IO_URING
+
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cstddef>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+const unsigned int UringPoller::_ENTRIES = 4096;
+const unsigned int UringPoller::_RECV_BUFFERS = 512;
+const size_t UringPoller::_RECV_BUFFER_SIZE = 4096;
+const size_t UringPoller::_MAX_RECEIVED = 256 * 1024;
+const uint16_t UringPoller::_BUFFER_GROUP = 0;
+const int UringPoller::_MAX_FD = (1 << 28) - 1;
+const uint64_t UringPoller::_IGNORED_USER_DATA = ~static_cast<uint64_t>(0);
+
+UringPoller::UringPoller()
+	: _ringFd(-1), _entries(0), _sqRing(MAP_FAILED), _sqRingSize(0), _sqHead(NULL), _sqTail(NULL),
+	  _sqMask(0), _sqArray(NULL), _sqes(static_cast<struct io_uring_sqe *>(MAP_FAILED)), _sqesSize(0),
+	  _sqPending(0), _cqRing(MAP_FAILED), _cqRingSize(0), _cqHead(NULL), _cqTail(NULL), _cqMask(0), _cqes(NULL),
+	  _bufRing(NULL), _buffers(NULL), _bufRingTail(NULL), _bufTail(0), _acceptSupported(false),
+	  _recvSupported(false), _acceptConfirmed(false), _recvConfirmed(false)
+{
+	if (!this->setup() && this->_ringFd != -1)
+	{
+		close(this->_ringFd);
+		this->_ringFd = -1;
+	}
+}
+
+UringPoller::~UringPoller()
+{
+	for (size_t fd = 0; fd < this->_interest.size(); ++fd)
+	{
+		for (size_t i = 0; i < this->_interest[fd].accepted.size(); ++i)
+			close(this->_interest[fd].accepted[i]);
+	}
+	if (this->_sqes != MAP_FAILED)
+		munmap(this->_sqes, this->_sqesSize);
+	if (this->_cqRing != MAP_FAILED && this->_cqRing != this->_sqRing)
+		munmap(this->_cqRing, this->_cqRingSize);
+	if (this->_sqRing != MAP_FAILED)
+		munmap(this->_sqRing, this->_sqRingSize);
+	if (this->_ringFd != -1)
+		close(this->_ringFd);
+	if (this->_bufRing)
+	{
+		munmap(this->_buffers, _RECV_BUFFERS * _RECV_BUFFER_SIZE);
+		munmap(this->_bufRing, _RECV_BUFFERS * sizeof(struct io_uring_buf));
+	}
+}
+
+// Creates the ring and maps its queues; false when the kernel lacks
+// io_uring, has it disabled, or predates the features used here
+bool UringPoller::setup()
+{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	this->_ringFd = syscall(__NR_io_uring_setup, _ENTRIES, &params);
+	if (this->_ringFd < 0)
+		return false;
+	if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP))
+	{
+		errno = ENOSYS;
+		return false;
+	}
+	this->_entries = params.sq_entries;
+
+	this->_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	this->_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (this->_cqRingSize > this->_sqRingSize)
+			this->_sqRingSize = this->_cqRingSize;
+		this->_cqRingSize = this->_sqRingSize;
+	}
+
+	this->_sqRing = mmap(NULL, this->_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+						 this->_ringFd, IORING_OFF_SQ_RING);
+	if (this->_sqRing == MAP_FAILED)
+		return false;
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		this->_cqRing = this->_sqRing;
+	else
+	{
+		this->_cqRing = mmap(NULL, this->_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+							 this->_ringFd, IORING_OFF_CQ_RING);
+		if (this->_cqRing == MAP_FAILED)
+			return false;
+	}
+	this->_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	this->_sqes = static_cast<struct io_uring_sqe *>(mmap(NULL, this->_sqesSize, PROT_READ | PROT_WRITE,
+														  MAP_SHARED | MAP_POPULATE, this->_ringFd, IORING_OFF_SQES));
+	if (this->_sqes == MAP_FAILED)
+		return false;
+
+	char *sq = static_cast<char *>(this->_sqRing);
+	this->_sqHead = reinterpret_cast<unsigned int *>(sq + params.sq_off.head);
+	this->_sqTail = reinterpret_cast<unsigned int *>(sq + params.sq_off.tail);
+	this->_sqMask = *reinterpret_cast<unsigned int *>(sq + params.sq_off.ring_mask);
+	this->_sqArray = reinterpret_cast<unsigned int *>(sq + params.sq_off.array);
+
+	char *cq = static_cast<char *>(this->_cqRing);
+	this->_cqHead = reinterpret_cast<unsigned int *>(cq + params.cq_off.head);
+	this->_cqTail = reinterpret_cast<unsigned int *>(cq + params.cq_off.tail);
+	this->_cqMask = *reinterpret_cast<unsigned int *>(cq + params.cq_off.ring_mask);
+	this->_cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+	this->_acceptSupported = true;
+	this->_recvSupported = this->setupBufferRing();
+	return true;
+}
+
+// Registers the buffers multishot recv fills; false when the kernel
+// predates IORING_REGISTER_PBUF_RING (5.19), recv() is used then
+bool UringPoller::setupBufferRing()
+{
+	size_t ringSize = _RECV_BUFFERS * sizeof(struct io_uring_buf);
+	size_t buffersSize = _RECV_BUFFERS * _RECV_BUFFER_SIZE;
+	void *ring = mmap(NULL, ringSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ring == MAP_FAILED)
+		return false;
+	void *buffers = mmap(NULL, buffersSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buffers == MAP_FAILED)
+	{
+		munmap(ring, ringSize);
+		return false;
+	}
+
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+	reg.ring_entries = _RECV_BUFFERS;
+	reg.bgid = _BUFFER_GROUP;
+	if (syscall(__NR_io_uring_register, this->_ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+	{
+		munmap(buffers, buffersSize);
+		munmap(ring, ringSize);
+		return false;
+	}
+
+	this->_bufRing = static_cast<struct io_uring_buf *>(ring);
+	this->_buffers = static_cast<char *>(buffers);
+	// The tail overlays the resv field of the first entry
+	this->_bufRingTail = reinterpret_cast<uint16_t *>(static_cast<char *>(ring) + offsetof(struct io_uring_buf, resv));
+	for (unsigned int id = 0; id < _RECV_BUFFERS; ++id)
+		this->recycleBuffer(id);
+	__atomic_store_n(this->_bufRingTail, this->_bufTail, __ATOMIC_RELEASE);
+	return true;
+}
+
+// Hands a buffer back to the kernel, published by the next wait()
+void UringPoller::recycleBuffer(uint16_t id)
+{
+	struct io_uring_buf &buf = this->_bufRing[this->_bufTail & (_RECV_BUFFERS - 1)];
+	buf.addr = reinterpret_cast<uint64_t>(this->_buffers + id * _RECV_BUFFER_SIZE);
+	buf.len = _RECV_BUFFER_SIZE;
+	buf.bid = id;
+	this->_bufTail++;
+}
+
+bool UringPoller::isValid() const
+{
+	return this->_ringFd != -1;
+}
+
+// generation:32 operation:4 fd:28
+uint64_t UringPoller::makeUserData(int fd, Operation operation, uint32_t generation)
+{
+	return (static_cast<uint64_t>(generation) << 32) | (static_cast<uint64_t>(operation) << 28) |
+		   static_cast<uint32_t>(fd);
+}
+
+// Next free SQE, submitting what is queued first if the ring is full
+struct io_uring_sqe *UringPoller::getSqe()
+{
+	unsigned int tail = *this->_sqTail;
+	if (tail - __atomic_load_n(this->_sqHead, __ATOMIC_ACQUIRE) >= this->_entries)
+	{
+		this->enter(this->_sqPending, 0, 0);
+		tail = *this->_sqTail;
+		if (tail - __atomic_load_n(this->_sqHead, __ATOMIC_ACQUIRE) >= this->_entries)
+			return NULL;
+	}
+
+	unsigned int index = tail & this->_sqMask;
+	struct io_uring_sqe *sqe = &this->_sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	this->_sqArray[index] = index;
+	__atomic_store_n(this->_sqTail, tail + 1, __ATOMIC_RELEASE);
+	this->_sqPending++;
+	return sqe;
+}
+
+// Submits the queued SQEs and waits for minComplete completions, at most
+// timeoutMs (-1 blocks)
+int UringPoller::enter(unsigned int toSubmit, unsigned int minComplete, int timeoutMs)
+{
+	unsigned int flags = 0;
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	memset(&arg, 0, sizeof(arg));
+	if (minComplete > 0)
+	{
+		flags |= IORING_ENTER_GETEVENTS;
+		if (timeoutMs >= 0)
+		{
+			ts.tv_sec = timeoutMs / 1000;
+			ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+			arg.ts = reinterpret_cast<uint64_t>(&ts);
+		}
+		flags |= IORING_ENTER_EXT_ARG;
+	}
+
+	int ret = syscall(__NR_io_uring_enter, this->_ringFd, toSubmit, minComplete, flags,
+					  (flags & IORING_ENTER_EXT_ARG) ? &arg : NULL, sizeof(arg));
+	if (ret >= 0)
+		this->_sqPending -= std::min(static_cast<unsigned int>(ret), this->_sqPending);
+	return ret;
+}
+
+// Grows the table to hold fd; false for fds too large for user_data
+bool UringPoller::ensureSlot(int fd)
+{
+	if (fd < 0 || fd > _MAX_FD)
+	{
+		errno = EBADF;
+		return false;
+	}
+	if (static_cast<size_t>(fd) >= this->_interest.size())
+	{
+		Interest none;
+		none.events = 0;
+		none.pollMask = 0;
+		none.added = false;
+		none.accepting = false;
+		none.receiving = false;
+		none.scheduled = false;
+		none.listedReady = false;
+		for (int op = 0; op < OP_COUNT; ++op)
+		{
+			none.requests[op].generation = 0;
+			none.requests[op].armed = false;
+		}
+		none.error = 0;
+		none.eof = false;
+		this->_interest.resize(fd + 1, none);
+		this->_eventIndex.resize(fd + 1, -1);
+	}
+	return true;
+}
+
+void UringPoller::schedule(int fd)
+{
+	Interest &interest = this->_interest[fd];
+	if (interest.scheduled)
+		return;
+	interest.scheduled = true;
+	this->_apply.push_back(fd);
+}
+
+// Brings the requests in flight for fd in line with its interest. Called
+// by wait() right before it submits, so the changes of an iteration
+// collapse into one: a client added then given to watchRecv() only ever
+// gets its recv.
+void UringPoller::apply(int fd)
+{
+	Interest &interest = this->_interest[fd];
+	interest.scheduled = false;
+	if (!interest.added)
+		return;
+
+	bool read = (interest.events & POLLER_READ) != 0;
+	bool wantAccept = read && interest.accepting && interest.error == 0;
+	bool wantRecv = read && interest.receiving && interest.error == 0 && !interest.eof &&
+					interest.received.size() < _MAX_RECEIVED;
+	unsigned int pollMask = 0;
+	if (read && !interest.accepting && !interest.receiving)
+		pollMask |= POLLIN;
+	if (interest.events & POLLER_WRITE)
+		pollMask |= POLLOUT;
+
+	if (interest.requests[OP_POLL].armed && interest.pollMask != pollMask)
+		this->cancel(fd, OP_POLL);
+	if (interest.requests[OP_ACCEPT].armed && !wantAccept)
+		this->cancel(fd, OP_ACCEPT);
+	if (interest.requests[OP_RECV].armed && !wantRecv)
+		this->cancel(fd, OP_RECV);
+	interest.pollMask = pollMask;
+
+	bool queued = true;
+	if (pollMask != 0 && !interest.requests[OP_POLL].armed)
+		queued = this->submit(fd, OP_POLL);
+	if (queued && wantAccept && !interest.requests[OP_ACCEPT].armed)
+		queued = this->submit(fd, OP_ACCEPT);
+	if (queued && wantRecv && !interest.requests[OP_RECV].armed)
+		queued = this->submit(fd, OP_RECV);
+	if (!queued)
+		this->schedule(fd); // Out of SQEs, retried by the next wait()
+}
+
+// Queues the request; false when the submission queue is full
+bool UringPoller::submit(int fd, Operation operation)
+{
+	struct io_uring_sqe *sqe = this->getSqe();
+	if (!sqe)
+		return false;
+
+	Interest &interest = this->_interest[fd];
+	Request &request = interest.requests[operation];
+	sqe->fd = fd;
+	sqe->user_data = makeUserData(fd, operation, request.generation);
+	if (operation == OP_POLL)
+	{
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->poll32_events = interest.pollMask;
+	}
+	else if (operation == OP_ACCEPT)
+	{
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+		sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+	}
+	else
+	{
+		sqe->opcode = IORING_OP_RECV;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = _BUFFER_GROUP;
+	}
+	request.armed = true;
+	return true;
+}
+
+// Cancels the request in flight; its completions carry an old generation
+void UringPoller::cancel(int fd, Operation operation)
+{
+	Request &request = this->_interest[fd].requests[operation];
+	if (request.armed)
+	{
+		struct io_uring_sqe *sqe = this->getSqe();
+		if (sqe)
+		{
+			sqe->opcode = (operation == OP_POLL) ? IORING_OP_POLL_REMOVE : IORING_OP_ASYNC_CANCEL;
+			sqe->fd = -1;
+			sqe->addr = makeUserData(fd, operation, request.generation);
+			sqe->user_data = _IGNORED_USER_DATA;
+		}
+		request.armed = false;
+	}
+	request.generation++;
+}
+
+bool UringPoller::hasCompleted(int fd) const
+{
+	const Interest &interest = this->_interest[fd];
+	return interest.added && (!interest.accepted.empty() || !interest.received.empty() ||
+							  interest.error != 0 || interest.eof);
+}
+
+void UringPoller::listReady(int fd)
+{
+	Interest &interest = this->_interest[fd];
+	if (interest.listedReady)
+		return;
+	interest.listedReady = true;
+	this->_ready.push_back(fd);
+}
+
+// Several completions for one fd are reported once
+void UringPoller::addEvent(std::vector<PollEvent> &events, int fd, unsigned int flags)
+{
+	if (this->_eventIndex[fd] >= 0)
+	{
+		events[this->_eventIndex[fd]].events |= flags;
+		return;
+	}
+	PollEvent event;
+	event.fd = fd;
+	event.events = flags;
+	this->_eventIndex[fd] = events.size();
+	events.push_back(event);
+}
+
+bool UringPoller::add(int fd, unsigned int events)
+{
+	if (!this->ensureSlot(fd))
+		return false;
+	Interest &interest = this->_interest[fd];
+	if (interest.added)
+		return this->modify(fd, events);
+
+	interest.events = events;
+	interest.added = true;
+	this->schedule(fd);
+	return true;
+}
+
+bool UringPoller::modify(int fd, unsigned int events)
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= this->_interest.size() || !this->_interest[fd].added)
+	{
+		errno = ENOENT;
+		return false;
+	}
+	Interest &interest = this->_interest[fd];
+	if (interest.events == events)
+		return true;
+	interest.events = events;
+	this->schedule(fd);
+	return true;
+}
+
+// Queued, not submitted: cancelled requests still hold the file until the
+// next wait(), which only delays its final release by one iteration
+void UringPoller::remove(int fd)
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= this->_interest.size() || !this->_interest[fd].added)
+		return;
+	Interest &interest = this->_interest[fd];
+	for (int op = 0; op < OP_COUNT; ++op)
+		this->cancel(fd, static_cast<Operation>(op));
+	for (size_t i = 0; i < interest.accepted.size(); ++i)
+		close(interest.accepted[i]);
+	interest.accepted.clear();
+	std::string().swap(interest.received);
+	interest.events = 0;
+	interest.pollMask = 0;
+	interest.added = false;
+	interest.accepting = false;
+	interest.receiving = false;
+	interest.error = 0;
+	interest.eof = false;
+}
+
+bool UringPoller::watchAccept(int listenFd)
+{
+	if (!this->_acceptSupported || listenFd < 0 || static_cast<size_t>(listenFd) >= this->_interest.size() ||
+		!this->_interest[listenFd].added)
+		return false;
+	this->_interest[listenFd].accepting = true;
+	this->schedule(listenFd);
+	return true;
+}
+
+bool UringPoller::watchRecv(int fd)
+{
+	if (!this->_recvSupported || fd < 0 || static_cast<size_t>(fd) >= this->_interest.size() ||
+		!this->_interest[fd].added)
+		return false;
+	this->_interest[fd].receiving = true;
+	this->schedule(fd);
+	return true;
+}
+
+int UringPoller::takeAccepted(int listenFd)
+{
+	// Multishot accept refused by the kernel after watchAccept() took the fd
+	if (listenFd < 0 || static_cast<size_t>(listenFd) >= this->_interest.size() ||
+		!this->_interest[listenFd].accepting)
+		return accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+	Interest &interest = this->_interest[listenFd];
+	if (!interest.accepted.empty())
+	{
+		int clientFd = interest.accepted.front();
+		interest.accepted.erase(interest.accepted.begin());
+		return clientFd;
+	}
+	if (interest.error != 0)
+	{
+		// Reported once, e.g. EMFILE, then accepting resumes
+		errno = interest.error;
+		interest.error = 0;
+		this->schedule(listenFd);
+		return -1;
+	}
+	errno = EAGAIN;
+	return -1;
+}
+
+ssize_t UringPoller::takeReceived(int fd, std::string &buffer, size_t maxBytes)
+{
+	// Multishot recv refused by the kernel after watchRecv() took the fd
+	if (fd < 0 || static_cast<size_t>(fd) >= this->_interest.size() || !this->_interest[fd].receiving)
+	{
+		size_t used = buffer.size();
+		buffer.resize(used + maxBytes);
+		ssize_t bytesRead = recv(fd, &buffer[used], maxBytes, MSG_DONTWAIT);
+		buffer.resize(used + (bytesRead > 0 ? bytesRead : 0));
+		return bytesRead;
+	}
+
+	Interest &interest = this->_interest[fd];
+	if (!interest.received.empty())
+	{
+		bool paused = interest.received.size() >= _MAX_RECEIVED;
+		size_t size = std::min(maxBytes, interest.received.size());
+		if (buffer.empty() && size == interest.received.size())
+			buffer.swap(interest.received); // The common case: a whole request, no copy
+		else
+		{
+			buffer.append(interest.received, 0, size);
+			interest.received.erase(0, size);
+		}
+		if (paused && interest.received.size() < _MAX_RECEIVED)
+			this->schedule(fd); // Receiving again
+		return size;
+	}
+	// Like recv(), the end of the stream and errors come after the data
+	if (interest.error != 0)
+	{
+		errno = interest.error;
+		return -1;
+	}
+	if (interest.eof)
+		return 0;
+	errno = EAGAIN;
+	return -1;
+}
+
+void UringPoller::complete(const struct io_uring_cqe &cqe, std::vector<PollEvent> &events)
+{
+	int fd = static_cast<int>(cqe.user_data & _MAX_FD);
+	int operation = static_cast<int>((cqe.user_data >> 28) & 0xf);
+	uint32_t generation = static_cast<uint32_t>(cqe.user_data >> 32);
+	bool hasBuffer = (cqe.flags & IORING_CQE_F_BUFFER) != 0;
+	uint16_t bufferId = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+
+	// Removed or modified since it was submitted: the data goes back to the
+	// ring and a connection accepted meanwhile is closed
+	if (operation >= OP_COUNT || static_cast<size_t>(fd) >= this->_interest.size() ||
+		this->_interest[fd].requests[operation].generation != generation ||
+		!this->_interest[fd].requests[operation].armed)
+	{
+		if (hasBuffer)
+			this->recycleBuffer(bufferId);
+		if (operation == OP_ACCEPT && cqe.res >= 0)
+			close(cqe.res);
+		return;
+	}
+
+	Interest &interest = this->_interest[fd];
+	if (!(cqe.flags & IORING_CQE_F_MORE))
+	{
+		// One-shot poll, or a multishot request that ended: re-armed if still wanted
+		interest.requests[operation].armed = false;
+		this->schedule(fd);
+	}
+
+	if (operation == OP_POLL)
+	{
+		unsigned int flags = 0;
+		if (cqe.res < 0)
+			flags = POLLER_ERROR;
+		else
+		{
+			if (cqe.res & POLLIN)
+				flags |= POLLER_READ;
+			if (cqe.res & POLLOUT)
+				flags |= POLLER_WRITE;
+			if (cqe.res & (POLLERR | POLLHUP))
+				flags |= POLLER_ERROR;
+		}
+		this->addEvent(events, fd, flags);
+		return;
+	}
+
+	if (operation == OP_ACCEPT)
+	{
+		if (cqe.res >= 0)
+		{
+			this->_acceptConfirmed = true;
+			interest.accepted.push_back(cqe.res);
+		}
+		else if (cqe.res == -EINVAL && !this->_acceptConfirmed)
+		{
+			// Kernel without multishot accept: poll, takeAccepted() calls accept4()
+			this->_acceptSupported = false;
+			interest.accepting = false;
+			return;
+		}
+		else if (cqe.res != -EAGAIN && cqe.res != -EINTR && cqe.res != -ECANCELED)
+			interest.error = -cqe.res;
+	}
+	else
+	{
+		if (cqe.res > 0 && hasBuffer)
+		{
+			this->_recvConfirmed = true;
+			interest.received.append(this->_buffers + bufferId * _RECV_BUFFER_SIZE, cqe.res);
+			if (interest.received.size() >= _MAX_RECEIVED)
+				this->schedule(fd); // Paused until taken, see apply()
+		}
+		else if (cqe.res == 0)
+			interest.eof = true;
+		else if (cqe.res == -EINVAL && !this->_recvConfirmed)
+		{
+			// Kernel without multishot recv: poll, takeReceived() calls recv()
+			this->_recvSupported = false;
+			interest.receiving = false;
+			return;
+		}
+		else if (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -EAGAIN && cqe.res != -EINTR &&
+				 cqe.res != -ECANCELED)
+			interest.error = -cqe.res;
+		// ENOBUFS ended the request: the buffers are back by the next wait(), which re-arms it
+		if (hasBuffer)
+			this->recycleBuffer(bufferId);
+	}
+	if (this->hasCompleted(fd))
+		this->listReady(fd);
+}
+
+int UringPoller::wait(std::vector<PollEvent> &events, int timeoutMs)
+{
+	events.clear();
+
+	// Completions not taken yet are reported again, like level-triggered readiness
+	bool pending = false;
+	size_t kept = 0;
+	for (size_t i = 0; i < this->_ready.size(); ++i)
+	{
+		int fd = this->_ready[i];
+		if (!this->hasCompleted(fd))
+		{
+			this->_interest[fd].listedReady = false;
+			continue;
+		}
+		this->_ready[kept++] = fd;
+		if (this->_interest[fd].events & POLLER_READ)
+			pending = true;
+	}
+	this->_ready.resize(kept);
+
+	// Interest changed since the last wait(), and requests that completed
+	std::vector<int> changed;
+	changed.swap(this->_apply);
+	for (size_t i = 0; i < changed.size(); ++i)
+		this->apply(changed[i]);
+
+	// With nothing to submit and completions already posted, no syscall at all
+	unsigned int head = *this->_cqHead;
+	bool posted = head != __atomic_load_n(this->_cqTail, __ATOMIC_ACQUIRE);
+	bool interrupted = false;
+	if (this->_sqPending > 0 || !posted)
+	{
+		int ret = this->enter(this->_sqPending, (posted || pending) ? 0 : 1, timeoutMs);
+		if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY)
+			return -1;
+		interrupted = (ret < 0 && errno == EINTR);
+	}
+
+	unsigned int tail = __atomic_load_n(this->_cqTail, __ATOMIC_ACQUIRE);
+	for (; head != tail; ++head)
+	{
+		const struct io_uring_cqe &cqe = this->_cqes[head & this->_cqMask];
+		if (cqe.user_data != _IGNORED_USER_DATA)
+			this->complete(cqe, events);
+	}
+	__atomic_store_n(this->_cqHead, head, __ATOMIC_RELEASE);
+	if (this->_bufRing)
+		__atomic_store_n(this->_bufRingTail, this->_bufTail, __ATOMIC_RELEASE);
+
+	for (size_t i = 0; i < this->_ready.size(); ++i)
+	{
+		int fd = this->_ready[i];
+		if ((this->_interest[fd].events & POLLER_READ) && this->hasCompleted(fd))
+			this->addEvent(events, fd, POLLER_READ);
+	}
+
+	for (size_t i = 0; i < events.size(); ++i)
+		this->_eventIndex[events[i].fd] = -1;
+	if (interrupted && events.empty())
+	{
+		errno = EINTR;
+		return -1;
+	}
+	return events.size();
+}
+
+const char *UringPoller::getName() const
+{
+	return "io_uring";
+}
+
+#endif
@@ -1,18 +1,89 @@
 #include <ConfigManager.hpp>
+#include <ConfigStore.hpp>
 #include <FileServer.hpp>
 #include <Server.hpp>
+#include <Master.hpp>
+#include <Reactor.hpp>
+#include <Poller.hpp>
+#include <Upgrade.hpp>
+#include <SocketActivation.hpp>
+#include <CpuAffinity.hpp>
 #include <iostream>
+#include <sys/resource.h>
+
+struct CommandLine
+{
+	std::string configPath;
+	std::string eventBackend; // Overrides the 'event_backend' directive when set
+};
+
+static bool parseCommandLine(int argc, char *argv[], CommandLine &cmd)
+{
+	int i = 1;
+	while (i < argc && argv[i][0] == '-')
+	{
+		std::string option = argv[i];
+		if (option == "-b" && i + 1 < argc)
+		{
+			cmd.eventBackend = argv[i + 1];
+			if (!Poller::isSupported(cmd.eventBackend))
+			{
+				std::cerr << "Unsupported event backend: " << cmd.eventBackend << std::endl;
+				return false;
+			}
+			i += 2;
+		}
+		else
+			return false;
+	}
+	if (i != argc - 1)
+		return false;
+	cmd.configPath = argv[i];
+	return true;
+}
+
+// Every connection needs an fd; 0 raises the soft limit to the hard one.
+// Asking for more than the hard limit needs CAP_SYS_RESOURCE.
+static void raiseFdLimit(int wanted)
+{
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) < 0)
+		return;
+	rlim_t target = (wanted > 0) ? static_cast<rlim_t>(wanted) : rl.rlim_max;
+	if (target != RLIM_INFINITY && target != rl.rlim_cur)
+	{
+		struct rlimit raised = rl;
+		raised.rlim_cur = target;
+		if (raised.rlim_max != RLIM_INFINITY && raised.rlim_max < target)
+			raised.rlim_max = target;
+		if (setrlimit(RLIMIT_NOFILE, &raised) < 0)
+			std::cerr << "Warning: cannot set the fd limit to " << target << ", keeping " << rl.rlim_cur << std::endl;
+		else
+			rl = raised;
+	}
+	std::cout << "File descriptor limit: " << rl.rlim_cur << std::endl;
+}
 
 int main(int argc, char *argv[])
 {
-	if (argc == 2)
+	CommandLine cmd;
+	if (parseCommandLine(argc, argv, cmd))
 	{
+		// Pre-opened listeners, from an older binary's SIGUSR2 (see Upgrade.hpp)
+		// or a supervisor's socket activation (see SocketActivation.hpp)
+		Upgrade::saveCommandLine(argc, argv);
+		std::vector<int> inheritedListeners;
+		Upgrade::takeInheritedListeners(inheritedListeners);
+		SocketActivation::takeListeners(inheritedListeners);
+
 		try
 		{
-			ConfigManager configManager;
-			configManager.loadConfig(argv[1]);
+			// Reloaded on SIGHUP, see ConfigStore
+			ConfigStore configStore(cmd.configPath);
+			ConfigStore::Snapshot *snapshot = configStore.acquire();
+			const ConfigManager &configManager = snapshot->config;
 
-			std::cout << "✅ Successfully parsed: " << argv[1] << "\n";
+			std::cout << "✅ Successfully parsed: " << cmd.configPath << "\n";
 			configManager.printConfiguration();
 			std::cout << std::endl;
 
@@ -54,20 +125,55 @@ int main(int argc, char *argv[])
 			}
 			std::cout << std::endl;
 
-			Server sv = Server(configManager);
-			sv.initialize();
+			// Workers and threads share it, and a reload cannot change it
+			raiseFdLimit(configManager.getWorkerRlimitNofile());
+
+			int workerCount = configManager.getWorkerProcesses();
+			int threadCount = configManager.getWorkerThreads();
+			std::vector<std::string> affinity = configManager.getWorkerCpuAffinity();
+			configStore.release(snapshot);
+
+			if (workerCount > 1)
+			{
+				Master master(configStore);
+				if (!cmd.eventBackend.empty())
+					master.setEventBackend(cmd.eventBackend);
+				master.setInheritedListeners(inheritedListeners);
+				return master.run(workerCount);
+			}
+
+			if (threadCount > 1)
+			{
+				Reactor reactor(configStore);
+				if (!cmd.eventBackend.empty())
+					reactor.setEventBackend(cmd.eventBackend);
+				reactor.setInheritedListeners(inheritedListeners);
+				reactor.setUpgradable(true);
+				reactor.setCpuAffinity(affinity, 0);
+				return reactor.run(threadCount);
+			}
+
+			CpuAffinity::pinCurrentThread(affinity, 0);
+			Server sv(configStore);
+			if (!cmd.eventBackend.empty())
+				sv.setEventBackend(cmd.eventBackend);
+			sv.setInheritedListeners(inheritedListeners);
+			sv.setUpgradable(true);
+			if (!sv.initialize())
+				return 1;
+			Upgrade::notifyReady();
 			sv.run();
 		}
 		catch (const std::exception &e)
 		{
-			std::cerr << "❌ Failed to parse " << argv[1] << "\n";
+			std::cerr << "❌ Failed to parse " << cmd.configPath << "\n";
 			std::cerr << e.what() << std::endl;
 			return 1;
 		}
 	}
 	else
 	{
-		std::cerr << "Usage: " << argv[0] << " <config_file_path>" << std::endl;
+		std::cerr << "Usage: " << argv[0] << " [-b select|poll|epoll|io_uring] <config_file_path>" << std::endl;
 		return 1;
 	}
 
@@ -0,0 +1,37 @@
+#!/bin/bash
+# A CGI request followed by a static one on the same keep-alive connection,
+# under every event backend. The CGI response leaves the client with an
+# empty interest mask while it waits on the script; the next request must
+# still be read from the reused connection.
+#
+# Usage: tests/cgi_keepalive_test.sh
+
+CONF=conf/advanced_config.conf
+BASE=http://127.0.0.1:8081
+BACKENDS=${BACKENDS:-"select poll epoll io_uring"}
+EXPECTED="200/1 200/0 200/0"
+
+cd "$(dirname "$0")/.." || exit 1
+make -s all || exit 1
+
+status=0
+for backend in $BACKENDS; do
+	./webserv -b "$backend" "$CONF" > /tmp/webserv_test.log 2>&1 &
+	pid=$!
+	sleep 0.5
+	# num_connects is 0 when curl reused the connection
+	got=$(curl -s -m 5 \
+		-o /dev/null -w "%{http_code}/%{num_connects}\n" "$BASE/cgi-bin/test.py" \
+		-o /dev/null -w "%{http_code}/%{num_connects}\n" "$BASE/" \
+		-o /dev/null -w "%{http_code}/%{num_connects}\n" "$BASE/cgi-bin/test.py" | xargs)
+	kill -INT "$pid"
+	wait "$pid" 2>/dev/null
+	if [ "$got" = "$EXPECTED" ] && ! grep -q "Error:" /tmp/webserv_test.log; then
+		echo "ok   $backend"
+	else
+		echo "FAIL $backend: got '$got', expected '$EXPECTED'"
+		grep "Error:" /tmp/webserv_test.log
+		status=1
+	fi
+done
+exit $status
@@ -0,0 +1,68 @@
+#!/bin/bash
+# Connection persistence by HTTP version: HTTP/1.1 persists by default,
+# HTTP/1.0 only with "Connection: keep-alive", and a request that fails to
+# parse is answered with 400 and its connection closed, so the bytes
+# pipelined behind it are never served.
+#
+# Usage: tests/keepalive_test.sh
+
+CONF=conf/basic_config.conf
+PORT=8080
+URL=http://127.0.0.1:$PORT/
+
+cd "$(dirname "$0")/.." || exit 1
+make -s all || exit 1
+
+./webserv "$CONF" > /tmp/webserv_test.log 2>&1 &
+pid=$!
+trap 'kill -INT "$pid" 2>/dev/null' EXIT
+sleep 0.5
+
+status=0
+check()
+{
+	if [ "$2" = "$3" ]; then
+		echo "ok   $1"
+	else
+		echo "FAIL $1: got '$2', expected '$3'"
+		status=1
+	fi
+}
+
+# num_connects is 0 when curl reused the connection
+twice()
+{
+	curl -s -m 5 "$@" -o /dev/null -w "%{http_code}/%{num_connects}\n" "$URL" \
+		-o /dev/null -w "%{http_code}/%{num_connects}\n" "$URL" | xargs
+}
+
+check "HTTP/1.1" "$(twice)" "200/1 200/0"
+check "HTTP/1.1 Connection: close" "$(twice -H 'Connection: close')" "200/1 200/1"
+check "HTTP/1.0" "$(twice --http1.0)" "200/1 200/1"
+check "HTTP/1.0 Connection: keep-alive" "$(twice --http1.0 -H 'Connection: keep-alive')" "200/1 200/0"
+
+# One write, so the server reads both requests before it answers. It must
+# answer the first with 400 and close, instead of serving the second.
+reply=$(python3 - "$PORT" <<'PY'
+import socket, sys
+s = socket.create_connection(("127.0.0.1", int(sys.argv[1])))
+s.settimeout(3)
+s.sendall(b"BROKEN\r\n\r\nGET / HTTP/1.1\r\nHost: localhost\r\n\r\n")
+data = b""
+try:
+	while True:
+		chunk = s.recv(65536)
+		if not chunk:
+			break
+		data += chunk
+	closed = "closed"
+except socket.timeout:
+	closed = "open"
+print(data.count(b"HTTP/1.1 "), data.split(b"\r\n")[0].decode(), closed)
+PY
+)
+check "malformed request" "$reply" "1 HTTP/1.1 400 Bad Request closed"
+
+kill -INT "$pid"
+wait "$pid" 2>/dev/null
+exit $status